@@ -0,0 +1,273 @@
+#include "block_cache.h"
+#include "io_sched.h"
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define BC_HASH_SIZE 512 // power of two, at least BC_NUM_BUFFERS
+
+typedef struct BC_ENTRY {
+    int address; // -1 if the buffer doesn't hold a block
+    int loading; // the block is being read from disk into the buffer
+    int pins;
+    int prev; // lru list, head is the most recently used
+    int next;
+    int hash_next;
+} BC_ENTRY;
+
+static char bc_data[BC_NUM_BUFFERS][BLOCK_SIZE];
+static BC_ENTRY bc_entries[BC_NUM_BUFFERS];
+static int bc_hash[BC_HASH_SIZE];
+static int lru_head = -1;
+static int lru_tail = -1;
+
+// guards the entries, the lru list and the hash table. disk reads happen
+// without it, threads needing a block that is being read wait on loaded
+static pthread_mutex_t bc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t loaded = PTHREAD_COND_INITIALIZER;
+
+static void lru_unlink(int i)
+{
+    if (bc_entries[i].prev != -1)
+        bc_entries[bc_entries[i].prev].next = bc_entries[i].next;
+    else
+        lru_head = bc_entries[i].next;
+
+    if (bc_entries[i].next != -1)
+        bc_entries[bc_entries[i].next].prev = bc_entries[i].prev;
+    else
+        lru_tail = bc_entries[i].prev;
+}
+
+static void lru_push_front(int i)
+{
+    bc_entries[i].prev = -1;
+    bc_entries[i].next = lru_head;
+    if (lru_head != -1)
+        bc_entries[lru_head].prev = i;
+    lru_head = i;
+    if (lru_tail == -1)
+        lru_tail = i;
+}
+
+static int hash_find(int address)
+{
+    int i = bc_hash[address & (BC_HASH_SIZE - 1)];
+    while (i != -1 && bc_entries[i].address != address)
+        i = bc_entries[i].hash_next;
+    return i;
+}
+
+static void hash_remove(int i)
+{
+    int *link = &(bc_hash[bc_entries[i].address & (BC_HASH_SIZE - 1)]);
+    while (*link != i)
+        link = &(bc_entries[*link].hash_next);
+    *link = bc_entries[i].hash_next;
+}
+
+// returns the index of a buffer now holding the given address without
+// filling it, or -1 if every buffer is pinned
+static int claim_buffer(int address)
+{
+    // the least recently used unpinned buffer is the victim
+    int i = lru_tail;
+    while (i != -1 && bc_entries[i].pins > 0)
+        i = bc_entries[i].prev;
+    if (i == -1)
+        return -1;
+
+    if (bc_entries[i].address != -1)
+        hash_remove(i);
+
+    bc_entries[i].address = address;
+    int bucket = address & (BC_HASH_SIZE - 1);
+    bc_entries[i].hash_next = bc_hash[bucket];
+    bc_hash[bucket] = i;
+    return i;
+}
+
+void bc_init()
+{
+    lru_head = -1;
+    lru_tail = -1;
+    for (int i = 0; i < BC_HASH_SIZE; i++)
+        bc_hash[i] = -1;
+    for (int i = 0; i < BC_NUM_BUFFERS; i++)
+    {
+        bc_entries[i].address = -1;
+        bc_entries[i].loading = 0;
+        bc_entries[i].pins = 0;
+        bc_entries[i].hash_next = -1;
+        lru_push_front(i);
+    }
+}
+
+// returns the index of the buffer holding the given address once it is
+// filled, or -1 if it isn't cached. may wait for the lock to be released
+static int find_loaded(int address)
+{
+    int i = hash_find(address);
+    while (i != -1 && bc_entries[i].loading)
+    {
+        pthread_cond_wait(&loaded, &bc_lock);
+        i = hash_find(address);
+    }
+    return i;
+}
+
+char *bc_get(int address)
+{
+    pthread_mutex_lock(&bc_lock);
+    int i = find_loaded(address);
+
+    if (i == -1)
+    {
+        i = claim_buffer(address);
+        if (i == -1)
+        {
+            pthread_mutex_unlock(&bc_lock);
+            return NULL;
+        }
+
+        // pinned so it stays put while the disk is read without the lock
+        bc_entries[i].loading = 1;
+        bc_entries[i].pins++;
+        pthread_mutex_unlock(&bc_lock);
+
+        // a metadata block may be newer in the journal than on disk
+        int failed = jn_read(address, bc_data[i]) < 0
+            && io_read(address, 1, bc_data[i]) < 0;
+
+        pthread_mutex_lock(&bc_lock);
+        bc_entries[i].loading = 0;
+        pthread_cond_broadcast(&loaded);
+        if (failed)
+        {
+            hash_remove(i);
+            bc_entries[i].address = -1;
+            bc_entries[i].pins--;
+            pthread_mutex_unlock(&bc_lock);
+            return NULL;
+        }
+    }
+    else
+    {
+        bc_entries[i].pins++;
+    }
+
+    lru_unlink(i);
+    lru_push_front(i);
+    pthread_mutex_unlock(&bc_lock);
+    return bc_data[i];
+}
+
+// completes a read started by bc_prefetch
+static void prefetch_done(void *arg, int failed)
+{
+    int i = (char*) arg - bc_data[0];
+    i /= BLOCK_SIZE;
+
+    pthread_mutex_lock(&bc_lock);
+    bc_entries[i].loading = 0;
+    pthread_cond_broadcast(&loaded);
+    if (failed)
+    {
+        hash_remove(i);
+        bc_entries[i].address = -1;
+    }
+    bc_entries[i].pins--;
+    pthread_mutex_unlock(&bc_lock);
+}
+
+void bc_prefetch(int address)
+{
+    pthread_mutex_lock(&bc_lock);
+    if (hash_find(address) != -1)
+    {
+        pthread_mutex_unlock(&bc_lock);
+        return;
+    }
+
+    int i = claim_buffer(address);
+    if (i == -1)
+    {
+        pthread_mutex_unlock(&bc_lock);
+        return;
+    }
+
+    // the buffer stays pinned until the read completes, like in bc_get
+    bc_entries[i].loading = 1;
+    bc_entries[i].pins++;
+    lru_unlink(i);
+    lru_push_front(i);
+    pthread_mutex_unlock(&bc_lock);
+
+    if (jn_read(address, bc_data[i]) == 0)
+        prefetch_done(bc_data[i], 0);
+    else
+        io_read_async(address, bc_data[i], prefetch_done, bc_data[i]);
+}
+
+void bc_release(const char *buf)
+{
+    int i = (buf - bc_data[0]) / BLOCK_SIZE;
+    pthread_mutex_lock(&bc_lock);
+    bc_entries[i].pins--;
+    pthread_mutex_unlock(&bc_lock);
+}
+
+int bc_read(int address, void *buf)
+{
+    char *block = bc_get(address);
+
+    // fall back to the disk when the cache is full of pinned buffers
+    if (block == NULL)
+    {
+        if (jn_read(address, buf) == 0)
+            return 0;
+        return io_read(address, 1, buf);
+    }
+
+    memcpy(buf, block, BLOCK_SIZE);
+    bc_release(block);
+    return 0;
+}
+
+int bc_write(int address, const void *buf)
+{
+    if (io_write(address, 1, buf) < 0)
+        return -1;
+
+    bc_update(address, buf);
+    return 0;
+}
+
+void bc_update(int address, const void *buf)
+{
+    pthread_mutex_lock(&bc_lock);
+    int i = find_loaded(address);
+
+    // a pinned buffer may be read by its holders without the lock, so it is
+    // left alone and a fresh one takes its place. the old buffer no longer
+    // holds a block and is reused once the last pin is released
+    if (i != -1 && bc_entries[i].pins > 0)
+    {
+        hash_remove(i);
+        bc_entries[i].address = -1;
+        i = -1;
+    }
+
+    if (i == -1)
+        i = claim_buffer(address);
+
+    if (i != -1)
+    {
+        memcpy(bc_data[i], buf, BLOCK_SIZE);
+        lru_unlink(i);
+        lru_push_front(i);
+    }
+    pthread_mutex_unlock(&bc_lock);
+}
@@ -0,0 +1,75 @@
+/**
+ * api for the block cache
+ * 
+ * the cache holds a fixed number of block sized buffers indexed by their disk
+ * address and evicts the least recently used one when it needs room. writes
+ * go through the cache to the disk so the disk is always up to date.
+ * 
+ * a block that is read through the cache must also be written through the
+ * cache, otherwise the cached copy goes stale
+ * 
+ * the cache may be used by several threads at once. blocks are read from
+ * disk without holding the cache's lock, so misses on different blocks are
+ * served in parallel. writes to one block must be ordered by the caller
+ * 
+ * the disk is accessed through the i/o scheduler, so blocks prefetched
+ * together are read with as few accesses as possible. metadata blocks are
+ * written through the journal, which updates the cache with bc_update, and
+ * are read from it when it holds a copy newer than the disk
+ */
+
+#include "common.h"
+
+#define BC_NUM_BUFFERS 256
+
+/**
+ * drops every cached block. must be called whenever a disk is (re)opened,
+ * while no other thread uses the cache
+ */
+void bc_init();
+
+/**
+ * returns a pointer to the cached contents of the block at the given address,
+ * reading it from disk if necessary. the buffer is pinned and won't be evicted
+ * or reused until it is released with bc_release
+ * 
+ * returns NULL if every buffer in the cache is pinned
+ */
+char *bc_get(int address);
+
+/**
+ * starts reading the block at the given address into the cache and returns
+ * without waiting for it. a later bc_get of the block waits for the read to
+ * complete. nothing is done if the block is already cached or every buffer
+ * is pinned
+ */
+void bc_prefetch(int address);
+
+/**
+ * unpins a buffer returned by bc_get. any pointer into the buffer may be given
+ */
+void bc_release(const char *buf);
+
+/**
+ * copies the block at the given address into buf
+ * 
+ * returns 0 on success
+ */
+int bc_read(int address, void *buf);
+
+/**
+ * writes buf to the block at the given address and updates the cached copy
+ * 
+ * returns 0 on success
+ */
+int bc_write(int address, const void *buf);
+
+/**
+ * caches buf as the contents of the block at the given address without
+ * writing it to disk
+ * 
+ * buffers pinned with bc_get are never modified. if the block's buffer is
+ * pinned, the new contents go in another buffer and the pinned one keeps the
+ * old contents until it is released
+ */
+void bc_update(int address, const void *buf);
@@ -1,42 +1,99 @@
 #ifndef _COMMON_H_
 #define _COMMON_H_
 
-#define MAX_FILENAME 28
-#define MAX_OPEN_FILES 100
+#define MAX_FILENAME 255
+#define MAX_OPEN_FILES 100 // initial size of the open file descriptor table
 
 #define BLOCK_SIZE 1024
-#define NUM_BLOCKS 8258 // 1 super block
+#define NUM_BLOCKS 8770 // 1 super block
                         // 64 blocks for inode table
-                        // 8192 data blocks
                         // 1 free bitmap block
+                        // 512 blocks for the journal
+                        // 8192 data blocks
 #define INODE_TABLE_LENGTH 64 // in blocks
+#define FM_ADDRESS (1 + INODE_TABLE_LENGTH)
+#define JOURNAL_ADDRESS (FM_ADDRESS + 1)
+#define JOURNAL_LENGTH 512 // in blocks
+#define FM_FIRST_DATA_BLOCK (JOURNAL_ADDRESS + JOURNAL_LENGTH)
+#define NUM_INODES 512
 #define ROOT_DIR_INODE_NUM 0
+#define SFS_MAGIC 0xABCD000A
+
+#define DIR_INDEX_BUCKETS 8 // blocks in the directory index, room for more
+                            // entries than there are inodes
+#define FM_GROUPS 8 // allocation groups the free map is split into
+#define FM_BITS (NUM_BLOCKS - FM_FIRST_DATA_BLOCK) // one per data block
+#define FM_GROUP_BITS (FM_BITS / FM_GROUPS) // a multiple of 32
+#define DIR_INDEX_BUCKET_ENTRIES 84
 
-// struct has a size of 32 bytes so there will be 32 dir entries per block
+// values of an inode's mode
+#define MODE_FILE 0
+#define MODE_DIR 1
+
+// in memory copy of a directory entry
 typedef struct DIR_ENTRY{
-    char filename[MAX_FILENAME];
+    char filename[MAX_FILENAME + 1];
     int inode_num;
 } DIR_ENTRY;
 
+// a directory's data is a list of variable length records. each one is this
+// header followed by the name, without a terminating null, padded to a
+// multiple of 4 bytes. rec_len reaches the next record so the records of a
+// block cover all of it and none spans two blocks. a record with inode number
+// 0 is unused space, the root directory is never an entry of a directory
+typedef struct DIR_RECORD {
+    int inode_num;
+    unsigned short rec_len;
+    unsigned char name_len;
+    unsigned char : 8;
+} DIR_RECORD;
+
+// bytes needed by a record with a name of the given length
+#define DIR_RECORD_LEN(name_len) ((sizeof(DIR_RECORD) + (name_len) + 3) & ~3)
+
+typedef struct DIR_INDEX_ENTRY {
+    unsigned int hash; // hash of the directory and the filename
+    int dir; // inode number of the directory holding the entry
+    int offset; // position of the entry's record in the directory
+} DIR_INDEX_ENTRY;
+
+// one block of the hash index shared by every directory, keyed on the
+// directory and the filename of each entry. an entry goes in the bucket
+// chosen by its hash, or the next one with room when that bucket is full, in
+// which case the full bucket counts it as overflowed so lookups keep probing.
+// the count drops back to 0 once every entry that went past it is removed
+typedef struct DIR_INDEX_BUCKET {
+    int count;
+    int overflows; // entries held by later buckets whose probe passes this one
+    DIR_INDEX_ENTRY entries[DIR_INDEX_BUCKET_ENTRIES];
+    long long : 64; // pads the struct to a block
+} DIR_INDEX_BUCKET;
+
 typedef struct SUPER_BLOCK {
     int magic_number;
     int block_size;
     int fs_size;
     int inode_table_length;
     int root_dir_inode_num;
+    int dir_index[DIR_INDEX_BUCKETS]; // addresses of the index buckets
+    // set when the file system was unmounted cleanly, in which case the
+    // summaries below are up to date and mounting doesn't rebuild them
+    int clean;
+    int free_blocks[FM_GROUPS]; // free blocks of each allocation group
+    unsigned int used_inodes[NUM_INODES / 32]; // bit set for each valid inode
 } SUPER_BLOCK;
 
 // padded to 128 bytes so exactly 8 inodes fit on a block
 typedef struct INODE {
     int valid;
-    int mode; /* not used */
+    int mode; // MODE_FILE or MODE_DIR
     int link_count;
     int uid; /* not used */
     int gid; /* not used */
     int size;
     int direct_ptr[12];
     int ind_ptr; // table of 256 direct pointers
-    int : 32; // int comes first for proper alignment
+    int free_block; // directories only, block searched first for room or -1
     long long : 64;
     long long : 64;
     long long : 64;
@@ -50,10 +107,17 @@ typedef struct OPEN_FILE_DESCRIPTOR_TABLE_ENTRY {
     int inode_num;
     int rptr;
     int wptr;
+    char *wbuf; // copy of the block being written to, or NULL
+    int wbuf_index; // index in the inode of the buffered block, -1 if none
+    int wbuf_dirty; // the buffer holds data not yet written to disk
+    int inode_dirty; // the cached inode changed since it was last written
+    int write_error; // a buffered block could not be written since the last
+                     // flush, which reports it
 } OPEN_FILE_DESCRIPTOR_TABLE_ENTRY;
 
-INODE inode_table_cache[512];
+// defined in sfs_util.c
+extern SUPER_BLOCK super_block_cache;
 
-OPEN_FILE_DESCRIPTOR_TABLE_ENTRY open_file_descriptor_table[MAX_OPEN_FILES];
+extern INODE inode_table_cache[NUM_INODES];
 
 #endif
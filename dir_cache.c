@@ -0,0 +1,922 @@
+#include "dir_cache.h"
+#include "sfs_util.h"
+#include "disk_emu.h"
+#include "block_cache.h"
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DC_MIN_CAPACITY 64 // power of two
+#define DC_MIGRATE_BATCH 16 // old table slots moved per operation while resizing
+#define DC_SLAB_NODES 1024 // nodes per slab
+#define DC_NEGATIVE_ENTRIES 64 // power of two
+#define DC_INLINE_NAME 32 // names shorter than this are stored in the node
+
+typedef struct DC_NODE {
+    char *filename; // inline_name, or a copy on the heap for long names
+    char inline_name[DC_INLINE_NAME];
+    int inode_num;
+    unsigned int hash;
+    int dir; // inode number of the directory holding the entry
+    int offset; // position of the entry's record in the directory
+    int index; // position of the node in the slabs
+    int next_free; // index of the next free node while this one is free
+} DC_NODE;
+
+// open addressing hash table indexing the nodes by directory and filename
+typedef struct DC_TABLE {
+    DC_NODE **slots;
+    int capacity; // power of two
+    int used; // live entries and tombstones
+    struct DC_TABLE *next_retired;
+} DC_TABLE;
+
+static int cached_entries = 0; // number of entries in the cache
+
+// nodes are carved out of fixed size slabs that are never moved or freed, so
+// the hash table can point into them. freed nodes are chained by index and
+// handed out again before the next unused node
+static DC_NODE **slabs = NULL;
+static int num_slabs = 0;
+static int slabs_cap = 0;
+static int nodes_used = 0; // nodes handed out from the slabs at least once
+static int free_node = -1;
+
+// marks a slot whose entry was removed, probing continues past it
+static DC_NODE tombstone;
+
+// holds an entry found on disk when no node could be allocated to cache it
+static DC_NODE uncached;
+
+// lookups go to the current table. while the table is being resized the
+// entries not yet moved out of the previous one are found in old_table.
+// either is NULL when it has no slots
+static DC_TABLE *table = NULL;
+static DC_TABLE *old_table = NULL;
+static int migrate_pos = 0;
+
+// dc_lookup_cached runs without the directory lock, in read sections counted
+// per parity of the epoch they started in. slots are changed with atomic
+// stores, and the nodes and tables taken out of the cache are retired rather
+// than freed. what was retired during an epoch is freed when the epoch after
+// next begins, which waits until no read section of the epoch is left
+static unsigned int epoch = 0;
+static int readers[2];
+static int retired_nodes[2] = { -1, -1 }; // chained by next_free
+static DC_TABLE *retired_tables[2];
+
+// sequence count of removals, odd while an entry is being removed. a read
+// section seeing it change can't trust the entries it found
+static unsigned int removals = 0;
+
+// number of entries in every directory, counted from the index the first time
+// it is needed. -1 until then
+static int num_entries = -1;
+
+// names recently looked up and found not to exist, placed by hash. a name is
+// dropped when a file is created with it, and a slot is overwritten when
+// another missing name hashes to it
+typedef struct DC_NEGATIVE {
+    int valid;
+    unsigned int hash;
+    int dir;
+    char filename[MAX_FILENAME + 1];
+} DC_NEGATIVE;
+
+static DC_NEGATIVE negative[DC_NEGATIVE_ENTRIES];
+
+// offset in the root directory of the next record returned by the listing
+static int listing_offset = 0;
+
+unsigned int dc_hash(int dir, const char *filename)
+{
+    // 32 bit FNV-1a over the directory's inode number then the filename
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < sizeof(int); i++)
+    {
+        hash ^= (dir >> (8 * i)) & 0xff;
+        hash *= 16777619u;
+    }
+    for (const unsigned char *c = (const unsigned char*) filename; *c != '\0'; c++)
+    {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// returns the slot holding the node with the given name and stores the node
+// in found, or returns -1
+static int ht_find_slot(DC_TABLE *t, int dir, const char *filename,
+        unsigned int hash, DC_NODE **found)
+{
+    if (t == NULL)
+        return -1;
+
+    int mask = t->capacity - 1;
+    DC_NODE *node;
+    for (int i = hash & mask;
+            (node = __atomic_load_n(&(t->slots[i]), __ATOMIC_ACQUIRE)) != NULL;
+            i = (i + 1) & mask)
+    {
+        if (node != &tombstone && node->hash == hash && node->dir == dir
+                && strcmp(node->filename, filename) == 0)
+        {
+            *found = node;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// the node is fully written before it is stored, lookups without the lock
+// may see it as soon as it is
+static void ht_set_slot(DC_TABLE *t, int i, DC_NODE *node)
+{
+    __atomic_store_n(&(t->slots[i]), node, __ATOMIC_RELEASE);
+}
+
+static void ht_place(DC_TABLE *t, DC_NODE *node)
+{
+    int mask = t->capacity - 1;
+    int i = node->hash & mask;
+    while (t->slots[i] != NULL && t->slots[i] != &tombstone)
+        i = (i + 1) & mask;
+
+    if (t->slots[i] == NULL)
+        t->used++;
+    ht_set_slot(t, i, node);
+}
+
+// retired tables and nodes are freed once no lookup without the lock can
+// still be using them
+static void table_retire(DC_TABLE *t)
+{
+    t->next_retired = retired_tables[epoch & 1];
+    retired_tables[epoch & 1] = t;
+}
+
+static void table_free(DC_TABLE *t)
+{
+    if (t != NULL)
+        free(t->slots);
+    free(t);
+}
+
+// moves a batch of entries from the old table to the current one, retiring
+// the old table once it is empty
+static void ht_migrate(int batch)
+{
+    while (old_table != NULL && batch-- > 0)
+    {
+        if (migrate_pos == old_table->capacity)
+        {
+            table_retire(old_table);
+            __atomic_store_n(&old_table, NULL, __ATOMIC_RELEASE);
+            break;
+        }
+
+        // the slot becomes a tombstone rather than empty so probing for the
+        // entries not moved yet still gets past it
+        DC_NODE *node = old_table->slots[migrate_pos];
+        if (node != NULL && node != &tombstone)
+        {
+            ht_place(table, node);
+            ht_set_slot(old_table, migrate_pos, &tombstone);
+        }
+        migrate_pos++;
+    }
+}
+
+// returns -1 if the table could not be allocated
+static int ht_insert(DC_NODE *node)
+{
+    ht_migrate(DC_MIGRATE_BATCH);
+
+    // grow once the table is three quarters full. entries are moved over a
+    // few at a time by later operations instead of all at once
+    int capacity = (table == NULL) ? 0 : table->capacity;
+    int used = (table == NULL) ? 0 : table->used;
+    if ((used + 1) * 4 > capacity * 3)
+    {
+        // only one resize can be in progress at a time
+        if (old_table != NULL)
+            ht_migrate(old_table->capacity + 1);
+
+        int live = used;
+        for (int i = 0; i < capacity; i++)
+            if (table->slots[i] == &tombstone)
+                live--;
+
+        // a table clogged with tombstones is rebuilt at the same size
+        if (capacity == 0)
+            capacity = DC_MIN_CAPACITY;
+        if ((live + 1) * 2 > capacity)
+            capacity *= 2;
+
+        DC_TABLE *grown = (DC_TABLE*) malloc(sizeof(DC_TABLE));
+        DC_NODE **slots = (DC_NODE**) calloc(capacity, sizeof(DC_NODE*));
+        if (grown == NULL || slots == NULL)
+        {
+            free(grown);
+            free(slots);
+            return -1;
+        }
+        grown->slots = slots;
+        grown->capacity = capacity;
+        grown->used = 0;
+
+        __atomic_store_n(&old_table, table, __ATOMIC_RELEASE);
+        migrate_pos = 0;
+        __atomic_store_n(&table, grown, __ATOMIC_RELEASE);
+    }
+
+    ht_place(table, node);
+    return 0;
+}
+
+static DC_NODE *ht_find(int dir, const char *filename, unsigned int hash)
+{
+    DC_NODE *node;
+    if (ht_find_slot(table, dir, filename, hash, &node) != -1)
+        return node;
+
+    if (ht_find_slot(old_table, dir, filename, hash, &node) != -1)
+        return node;
+
+    return NULL;
+}
+
+static void ht_remove(DC_NODE *node)
+{
+    ht_migrate(DC_MIGRATE_BATCH);
+
+    DC_NODE *found;
+    int i = ht_find_slot(table, node->dir, node->filename, node->hash, &found);
+    if (i != -1)
+    {
+        ht_set_slot(table, i, &tombstone);
+        return;
+    }
+
+    i = ht_find_slot(old_table, node->dir, node->filename, node->hash, &found);
+    if (i != -1)
+        ht_set_slot(old_table, i, &tombstone);
+}
+
+static void ht_clear()
+{
+    table_free(table);
+    table_free(old_table);
+    table = NULL;
+    old_table = NULL;
+    migrate_pos = 0;
+}
+
+
+// returns the record at the given position of a directory block
+#define RECORD_AT(block_buf, pos) ((DIR_RECORD*) ((block_buf) + (pos)))
+
+// reads the block of the directory holding the given offset
+// returns the address of the block, or -1 past the end of the directory
+static int read_dir_block(int dir, int offset, char *block_buf)
+{
+    INODE *dir_inode_ptr = &(inode_table_cache[dir]);
+    if (offset >= dir_inode_ptr->size)
+    {
+        return -1;
+    }
+
+    int cur_address = inode_index_to_address(*dir_inode_ptr, offset / BLOCK_SIZE);
+    if (cur_address <= 0)
+    {
+        return -1;
+    }
+
+    bc_read(cur_address, block_buf);
+    return cur_address;
+}
+
+static void record_to_entry(const DIR_RECORD *record, DIR_ENTRY *dir_entry)
+{
+    dir_entry->inode_num = record->inode_num;
+    memcpy(dir_entry->filename, (const char*) (record + 1), record->name_len);
+    dir_entry->filename[record->name_len] = '\0';
+}
+
+// makes room for a record of the given length in a directory block, either
+// in unused space or by splitting off the tail of a record longer than its
+// name needs. the new record's rec_len is set, the rest is up to the caller
+//
+// returns the position of the new record in the block, or -1 if it is full
+static int block_make_room(char *block_buf, int record_len)
+{
+    int pos = 0;
+    while (pos < BLOCK_SIZE)
+    {
+        DIR_RECORD *record = RECORD_AT(block_buf, pos);
+        if (record->rec_len < sizeof(DIR_RECORD))
+            break; // damaged block, don't write to it
+
+        if (record->inode_num == 0 && record->rec_len >= record_len)
+            return pos;
+
+        int used = DIR_RECORD_LEN(record->name_len);
+        if (record->inode_num != 0 && record->rec_len - used >= record_len)
+        {
+            RECORD_AT(block_buf, pos + used)->rec_len = record->rec_len - used;
+            record->rec_len = used;
+            return pos + used;
+        }
+
+        pos += record->rec_len;
+    }
+    return -1;
+}
+
+// frees the blocks at the end of the directory that hold no entries
+static void trim_empty_blocks(int dir)
+{
+    INODE *dir_inode_ptr = &(inode_table_cache[dir]);
+    char block_buf[BLOCK_SIZE];
+
+    while (dir_inode_ptr->size > 0)
+    {
+        int last = dir_inode_ptr->size / BLOCK_SIZE - 1;
+        if (read_dir_block(dir, last * BLOCK_SIZE, block_buf) == -1)
+            break;
+
+        DIR_RECORD *record = RECORD_AT(block_buf, 0);
+        if (record->inode_num != 0 || record->rec_len != BLOCK_SIZE)
+            break;
+
+        deallocate_inode_blocks(dir_inode_ptr, last);
+        inode_set_size(dir, dir_inode_ptr->size - BLOCK_SIZE);
+    }
+
+    if (dir_inode_ptr->free_block >= dir_inode_ptr->size / BLOCK_SIZE)
+        dir_inode_ptr->free_block = -1;
+}
+
+// looks the entry up in the on-disk index, reading its bucket and the
+// directory block of each entry with the same hash. the probe only moves on
+// to the next bucket while some entry overflowed past this one
+//
+// returns the offset of the entry's record and copies it to dir_entry, or -1
+static int index_find(int dir, const char *filename, unsigned int hash, DIR_ENTRY *dir_entry)
+{
+    DIR_INDEX_BUCKET bucket;
+    char block_buf[BLOCK_SIZE];
+    int name_len = strlen(filename);
+
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+    {
+        bc_read(super_block_cache.dir_index[(hash + i) % DIR_INDEX_BUCKETS], &bucket);
+        for (int j = 0; j < bucket.count; j++)
+        {
+            int offset = bucket.entries[j].offset;
+            if (bucket.entries[j].hash != hash || bucket.entries[j].dir != dir
+                    || read_dir_block(dir, offset, block_buf) == -1)
+            {
+                continue;
+            }
+
+            DIR_RECORD *record = RECORD_AT(block_buf, offset % BLOCK_SIZE);
+            if (record->inode_num != 0 && record->name_len == name_len
+                    && memcmp(record + 1, filename, name_len) == 0)
+            {
+                record_to_entry(record, dir_entry);
+                return offset;
+            }
+        }
+
+        if (bucket.overflows == 0)
+            break;
+    }
+    return -1;
+}
+
+// adds or takes away one overflow of each of the first n buckets of the
+// probe starting at the hash's home bucket
+static void index_count_overflows(unsigned int hash, int n, int delta)
+{
+    DIR_INDEX_BUCKET bucket;
+    for (int i = 0; i < n; i++)
+    {
+        int address = super_block_cache.dir_index[(hash + i) % DIR_INDEX_BUCKETS];
+        bc_read(address, &bucket);
+        bucket.overflows += delta;
+        jn_write(address, &bucket);
+    }
+}
+
+// returns -1 if every bucket is full
+static int index_add(unsigned int hash, int dir, int offset)
+{
+    DIR_INDEX_BUCKET bucket;
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+    {
+        int address = super_block_cache.dir_index[(hash + i) % DIR_INDEX_BUCKETS];
+        bc_read(address, &bucket);
+        if (bucket.count < DIR_INDEX_BUCKET_ENTRIES)
+        {
+            bucket.entries[bucket.count].hash = hash;
+            bucket.entries[bucket.count].dir = dir;
+            bucket.entries[bucket.count].offset = offset;
+            bucket.count++;
+            jn_write(address, &bucket);
+
+            // the full buckets passed over lead lookups on to this one
+            index_count_overflows(hash, i, 1);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void index_remove(unsigned int hash, int dir, int offset)
+{
+    DIR_INDEX_BUCKET bucket;
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+    {
+        int address = super_block_cache.dir_index[(hash + i) % DIR_INDEX_BUCKETS];
+        bc_read(address, &bucket);
+        for (int j = 0; j < bucket.count; j++)
+        {
+            if (bucket.entries[j].dir == dir && bucket.entries[j].offset == offset)
+            {
+                // the last entry fills the gap
+                bucket.count--;
+                bucket.entries[j] = bucket.entries[bucket.count];
+                jn_write(address, &bucket);
+                index_count_overflows(hash, i, -1);
+                return;
+            }
+        }
+
+        if (bucket.overflows == 0)
+            return;
+    }
+}
+
+// returns the node at the given index of the slabs
+static DC_NODE *slab_node(int index)
+{
+    return &(slabs[index / DC_SLAB_NODES][index % DC_SLAB_NODES]);
+}
+
+// returns NULL if a new slab could not be allocated
+static DC_NODE *node_alloc()
+{
+    if (free_node != -1)
+    {
+        DC_NODE *node = slab_node(free_node);
+        free_node = node->next_free;
+        return node;
+    }
+
+    if (nodes_used == num_slabs * DC_SLAB_NODES)
+    {
+        if (num_slabs == slabs_cap)
+        {
+            int cap = (slabs_cap == 0) ? 16 : slabs_cap * 2;
+            DC_NODE **grown = (DC_NODE**) realloc(slabs, cap * sizeof(DC_NODE*));
+            if (grown == NULL)
+                return NULL;
+            slabs = grown;
+            slabs_cap = cap;
+        }
+
+        DC_NODE *slab = (DC_NODE*) malloc(DC_SLAB_NODES * sizeof(DC_NODE));
+        if (slab == NULL)
+            return NULL;
+        slabs[num_slabs++] = slab;
+    }
+
+    DC_NODE *node = slab_node(nodes_used);
+    node->index = nodes_used++;
+    node->filename = NULL;
+    return node;
+}
+
+static void node_free(DC_NODE *node)
+{
+    if (node->filename != node->inline_name)
+        free(node->filename);
+    node->filename = NULL;
+
+    node->next_free = free_node;
+    free_node = node->index;
+}
+
+// frees what was retired two epochs ago and starts the next epoch, unless a
+// read section of the previous epoch is still running
+static void reclaim()
+{
+    int old = (epoch + 1) & 1;
+    if (__atomic_load_n(&(readers[old]), __ATOMIC_SEQ_CST) != 0)
+        return;
+
+    while (retired_nodes[old] != -1)
+    {
+        DC_NODE *node = slab_node(retired_nodes[old]);
+        retired_nodes[old] = node->next_free;
+        node_free(node);
+    }
+    while (retired_tables[old] != NULL)
+    {
+        DC_TABLE *t = retired_tables[old];
+        retired_tables[old] = t->next_retired;
+        table_free(t);
+    }
+
+    __atomic_store_n(&epoch, epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+// adds a node to the hash table
+static DC_NODE *cache_insert(int dir, const char *filename, int inode_num,
+        int offset, unsigned int hash)
+{
+    DC_NODE *new_node = node_alloc();
+
+    // return immediately if allocation fails
+    if (new_node == NULL)
+    {
+        return NULL;
+    }
+
+    // short names are kept in the node itself
+    int len = strlen(filename);
+    new_node->filename = (len < DC_INLINE_NAME) ? new_node->inline_name : (char*) malloc(len + 1);
+    if (new_node->filename == NULL)
+    {
+        node_free(new_node);
+        return NULL;
+    }
+
+    strcpy(new_node->filename, filename);
+    new_node->inode_num = inode_num;
+    new_node->hash = hash;
+    new_node->dir = dir;
+    new_node->offset = offset;
+
+    if (ht_insert(new_node) == -1)
+    {
+        node_free(new_node);
+        return NULL;
+    }
+
+    cached_entries++;
+    reclaim();
+    return new_node;
+}
+
+// takes a node out of the hash table and retires it
+static void cache_remove(DC_NODE *cur_node)
+{
+    ht_remove(cur_node);
+    cur_node->next_free = retired_nodes[epoch & 1];
+    retired_nodes[epoch & 1] = cur_node->index;
+    cached_entries--;
+    reclaim();
+}
+
+// returns the slot of the negative cache the entry would be in
+static DC_NEGATIVE *negative_slot(int dir, const char *filename, unsigned int hash, int *found)
+{
+    DC_NEGATIVE *neg = &(negative[hash & (DC_NEGATIVE_ENTRIES - 1)]);
+    *found = neg->valid && neg->hash == hash && neg->dir == dir
+            && strcmp(neg->filename, filename) == 0;
+    return neg;
+}
+
+// finds the entry in the cache, or on disk in which case it is added to the
+// cache. returns NULL if the entry doesn't exist
+static DC_NODE *find(int dir, const char *filename)
+{
+    unsigned int hash = dc_hash(dir, filename);
+    DC_NODE *node = ht_find(dir, filename, hash);
+    if (node != NULL)
+    {
+        return node;
+    }
+
+    // a name too long to be stored can't exist
+    if (strlen(filename) > MAX_FILENAME)
+    {
+        return NULL;
+    }
+
+    int found;
+    DC_NEGATIVE *neg = negative_slot(dir, filename, hash, &found);
+    if (found)
+    {
+        return NULL;
+    }
+
+    DIR_ENTRY dir_entry;
+    int offset = index_find(dir, filename, hash, &dir_entry);
+    if (offset == -1)
+    {
+        neg->valid = 1;
+        neg->hash = hash;
+        neg->dir = dir;
+        strcpy(neg->filename, filename);
+        return NULL;
+    }
+
+    // when the node can't be allocated the entry is still returned, it will
+    // be read from disk again next time
+    node = cache_insert(dir, filename, dir_entry.inode_num, offset, hash);
+    if (node == NULL)
+    {
+        uncached.filename = uncached.inline_name;
+        uncached.inode_num = dir_entry.inode_num;
+        uncached.hash = hash;
+        uncached.dir = dir;
+        uncached.offset = offset;
+        node = &uncached;
+    }
+    return node;
+}
+
+void dc_init()
+{
+    // erase contents, keeping the slabs for the nodes loaded next. nothing is
+    // read from disk until it is looked up
+    for (int i = 0; i < nodes_used; i++)
+    {
+        DC_NODE *node = slab_node(i);
+        if (node->filename != NULL && node->filename != node->inline_name)
+            free(node->filename);
+    }
+    nodes_used = 0;
+    free_node = -1;
+    for (int i = 0; i < 2; i++)
+    {
+        retired_nodes[i] = -1;
+        while (retired_tables[i] != NULL)
+        {
+            DC_TABLE *t = retired_tables[i];
+            retired_tables[i] = t->next_retired;
+            table_free(t);
+        }
+    }
+    cached_entries = 0;
+    num_entries = -1;
+    listing_offset = 0;
+    memset(negative, 0, sizeof(negative));
+    ht_clear();
+}
+
+int dc_size()
+{
+    if (num_entries == -1)
+    {
+        DIR_INDEX_BUCKET bucket;
+        num_entries = 0;
+        for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+        {
+            bc_read(super_block_cache.dir_index[i], &bucket);
+            num_entries += bucket.count;
+        }
+    }
+    return num_entries;
+}
+
+
+int dc_insert(int dir, DIR_ENTRY dir_entry)
+{
+    INODE *dir_inode_ptr = &(inode_table_cache[dir]);
+    int num_blocks = dir_inode_ptr->size / BLOCK_SIZE;
+    int name_len = strlen(dir_entry.filename);
+    char block_buf[BLOCK_SIZE];
+    int block_i = 0;
+    int cur_address = -1;
+    int pos = -1;
+
+    // look for room starting from the block the last change was made to, the
+    // other blocks are only read when it is full
+    int start = dir_inode_ptr->free_block;
+    if (start < 0 || start >= num_blocks)
+        start = num_blocks - 1;
+    for (int i = 0; i < num_blocks && pos == -1; i++)
+    {
+        block_i = (start + i) % num_blocks;
+        cur_address = read_dir_block(dir, block_i * BLOCK_SIZE, block_buf);
+        if (cur_address != -1)
+            pos = block_make_room(block_buf, DIR_RECORD_LEN(name_len));
+    }
+
+    // otherwise the directory grows by a block. a block left over from an
+    // insert that failed is reused
+    int grown = 0;
+    if (pos == -1)
+    {
+        block_i = num_blocks;
+        cur_address = inode_index_to_address(*dir_inode_ptr, block_i);
+        if (cur_address == 0)
+            cur_address = allocate_block_to_inode(dir_inode_ptr, block_i);
+        if (cur_address <= 0)
+        {
+            return -1;
+        }
+
+        memset(block_buf, 0, BLOCK_SIZE);
+        RECORD_AT(block_buf, 0)->rec_len = BLOCK_SIZE;
+        pos = 0;
+        grown = 1;
+    }
+
+    int offset = block_i * BLOCK_SIZE + pos;
+    unsigned int hash = dc_hash(dir, dir_entry.filename);
+    if (index_add(hash, dir, offset) == -1)
+    {
+        return -1;
+    }
+
+    // the name exists now
+    int found;
+    DC_NEGATIVE *neg = negative_slot(dir, dir_entry.filename, hash, &found);
+    if (found)
+        neg->valid = 0;
+
+    DIR_RECORD *record = RECORD_AT(block_buf, pos);
+    record->inode_num = dir_entry.inode_num;
+    record->name_len = name_len;
+    memcpy(record + 1, dir_entry.filename, name_len);
+    jn_write(cur_address, block_buf);
+
+    if (grown)
+        inode_set_size(dir, dir_inode_ptr->size + BLOCK_SIZE);
+    dir_inode_ptr->free_block = block_i;
+
+    // the entry is on disk, failing to cache it only costs a later read
+    cache_insert(dir, dir_entry.filename, dir_entry.inode_num, offset, hash);
+    if (num_entries != -1)
+        num_entries++;
+    if (dir == ROOT_DIR_INODE_NUM)
+        listing_offset = 0; // restart listing
+    return 0;
+}
+
+// marks the start and the end of a removal for read sections
+static void removal_begin()
+{
+    __atomic_store_n(&removals, removals + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void removal_end()
+{
+    __atomic_store_n(&removals, removals + 1, __ATOMIC_RELEASE);
+}
+
+// dc_remove between removal_begin and removal_end
+static int remove_entry(int dir, const char *filename)
+{
+    INODE *dir_inode_ptr = &(inode_table_cache[dir]);
+    DC_NODE *cur_node = find(dir, filename);
+
+    // return with failure if entry not found
+    if (cur_node == NULL)
+    {
+        return -1;
+    }
+
+    char block_buf[BLOCK_SIZE];
+    int cur_address = read_dir_block(dir, cur_node->offset, block_buf);
+    if (cur_address == -1)
+    {
+        return -1;
+    }
+
+    // find the record before the entry's in its block
+    int target = cur_node->offset % BLOCK_SIZE;
+    int pos = 0;
+    int prev = -1;
+    while (pos < target && RECORD_AT(block_buf, pos)->rec_len != 0)
+    {
+        prev = pos;
+        pos += RECORD_AT(block_buf, pos)->rec_len;
+    }
+    if (pos != target)
+    {
+        return -1;
+    }
+
+    // the previous record takes over the entry's space. the first record of
+    // a block is marked unused instead
+    DIR_RECORD *record = RECORD_AT(block_buf, target);
+    if (prev == -1)
+    {
+        record->inode_num = 0;
+        record->name_len = 0;
+    }
+    else
+    {
+        RECORD_AT(block_buf, prev)->rec_len += record->rec_len;
+    }
+    jn_write(cur_address, block_buf);
+
+    dir_inode_ptr->free_block = cur_node->offset / BLOCK_SIZE;
+    trim_empty_blocks(dir);
+
+    index_remove(cur_node->hash, dir, cur_node->offset);
+    if (cur_node != &uncached)
+        cache_remove(cur_node);
+    if (num_entries != -1)
+        num_entries--;
+    if (dir == ROOT_DIR_INODE_NUM)
+        listing_offset = 0; // restart listing
+    return 0;
+}
+
+int dc_remove(int dir, const char *filename)
+{
+    removal_begin();
+    int retval = remove_entry(dir, filename);
+    removal_end();
+    return retval;
+}
+
+int dc_lookup(int dir, const char *filename)
+{
+    DC_NODE *node = find(dir, filename);
+    return (node == NULL) ? -1 : node->inode_num;
+}
+
+void dc_read_begin(DC_READ *section)
+{
+    section->epoch = __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&(readers[section->epoch & 1]), 1, __ATOMIC_SEQ_CST);
+    section->removals = __atomic_load_n(&removals, __ATOMIC_ACQUIRE);
+}
+
+int dc_read_end(DC_READ *section)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    int unchanged = !(section->removals & 1)
+            && __atomic_load_n(&removals, __ATOMIC_RELAXED) == section->removals;
+    __atomic_sub_fetch(&(readers[section->epoch & 1]), 1, __ATOMIC_RELEASE);
+    return unchanged;
+}
+
+int dc_lookup_cached(int dir, const char *filename)
+{
+    unsigned int hash = dc_hash(dir, filename);
+    DC_NODE *node;
+
+    if (ht_find_slot(__atomic_load_n(&table, __ATOMIC_ACQUIRE), dir, filename,
+                hash, &node) != -1
+            || ht_find_slot(__atomic_load_n(&old_table, __ATOMIC_ACQUIRE), dir,
+                filename, hash, &node) != -1)
+    {
+        return node->inode_num;
+    }
+    return -1;
+}
+
+int dc_readdir(int dir, int offset, DIR_ENTRY *dir_entry)
+{
+    char block_buf[BLOCK_SIZE];
+    if (offset < 0)
+        offset = 0;
+
+    // walk the records from the start of the block holding the offset, each
+    // directory block is read once
+    int block_start = offset - offset % BLOCK_SIZE;
+    for (; read_dir_block(dir, block_start, block_buf) != -1; block_start += BLOCK_SIZE)
+    {
+        int pos = 0;
+        while (pos < BLOCK_SIZE)
+        {
+            DIR_RECORD *record = RECORD_AT(block_buf, pos);
+            if (record->rec_len < sizeof(DIR_RECORD))
+                break;
+
+            if (block_start + pos >= offset && record->inode_num != 0)
+            {
+                record_to_entry(record, dir_entry);
+                return block_start + pos + record->rec_len;
+            }
+            pos += record->rec_len;
+        }
+    }
+    return 0;
+}
+
+// return 1 if succesful
+int dc_getnextfilename(char *filename)
+{
+    DIR_ENTRY dir_entry;
+    listing_offset = dc_readdir(ROOT_DIR_INODE_NUM, listing_offset, &dir_entry);
+    if (listing_offset == 0)
+    {
+        return 0; // end of the listing, the next call starts over
+    }
+
+    strcpy(filename, dir_entry.filename);
+    return 1;
+}
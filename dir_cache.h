@@ -0,0 +1,132 @@
+/**
+ * api for the directory cache
+ * 
+ * caches the entries of every directory, keyed on the inode number of the
+ * directory holding them and their filename, so resolving a path costs one
+ * lookup per component whatever the size of the other directories
+ * 
+ * cached entries are stored in nodes allocated from fixed size slabs, freed
+ * nodes being chained by index for reuse. an open addressing hash table keyed
+ * on the directory and filename points to the nodes. the table grows
+ * incrementally, moving a few entries at a time, so no single operation pays
+ * for a full rehash
+ * 
+ * a directory on disk is a list of variable length records packed in its
+ * blocks, a record taking only the room its name needs. entries never move
+ * once written, their offsets identify them. the entries of every directory
+ * are indexed by a fixed number of hash buckets whose addresses are kept in
+ * the super block. entries are read into the cache as they are looked up, a
+ * lookup that misses the cache reads the entry's bucket and the directory
+ * block it points to through the block cache, so mounting doesn't read any
+ * directory at all. names found not to exist are remembered as well, until a
+ * file is created with them, so repeated lookups of missing names don't go to
+ * the index
+ * 
+ * changes are written through the journal to the on-disk directory one
+ * block at a time. a removed entry's space is merged into the record before
+ * it and reused by later inserts, which look in the block last changed
+ * first. the directory inode's size and that block are updated in the inode
+ * table cache only, it is up to the caller to write it to disk
+ * 
+ * the cache isn't locked, even lookups change it. callers hold the directory
+ * lock of sfs_api.c, except for dc_lookup_cached which only reads what is
+ * already cached. it runs in a read section, nodes and hash tables taken out
+ * of the cache being freed only once every read section that may have seen
+ * them has ended
+ */
+
+#include "common.h"
+
+// a section of lookups done without the directory lock
+typedef struct DC_READ {
+    unsigned int epoch;
+    unsigned int removals;
+} DC_READ;
+
+/**
+ * empties the cache. entries of the on-disk directories are loaded when
+ * they are first looked up
+ */
+void dc_init();
+
+/**
+ * returns the number of entries in all directories
+ */
+int dc_size();
+
+/**
+ * writes the given entry to free space in the directory and to the index,
+ * allocating a directory block if needed, and caches it
+ * 
+ * returns -1 if the function failed to allocate a directory block or the
+ * index is full.
+ * returns 0 on success
+ */
+int dc_insert(int dir, DIR_ENTRY dir_entry);
+
+/**
+ * removes an entry of the directory based on its filename and frees its
+ * record on disk. blocks left empty at the end of the directory are freed
+ * 
+ * returns -1 if the entry is not found
+ * returns 0 on success
+ */
+int dc_remove(int dir, const char *filename);
+
+/**
+ * finds the entry of the directory that matches the filename and returns
+ * the associated inode number
+ * 
+ * returns -1 if no entry is found
+ */
+int dc_lookup(int dir, const char *filename);
+
+/**
+ * starts a read section, within which dc_lookup_cached may be called without
+ * holding the directory lock. sections are short and never wait for a writer
+ */
+void dc_read_begin(DC_READ *section);
+
+/**
+ * ends a read section
+ * 
+ * returns 0 if an entry was removed while it ran, in which case the results
+ * of its lookups may be stale and should be discarded. returns 1 otherwise
+ */
+int dc_read_end(DC_READ *section);
+
+/**
+ * looks the entry up among the cached ones only, without the directory lock.
+ * must be called in a read section
+ * 
+ * returns -1 if the entry isn't cached, which doesn't mean it doesn't exist
+ * returns the inode number of the entry otherwise
+ */
+int dc_lookup_cached(int dir, const char *filename);
+
+/**
+ * returns the hash of the directory and filename used to index the entries
+ */
+unsigned int dc_hash(int dir, const char *filename);
+
+/**
+ * copies the first entry of the directory at or after the given offset to
+ * dir_entry. offsets are positions of records in the on-disk directory,
+ * which never move, so a listing can be resumed from the returned offset
+ * while files are created and removed
+ * 
+ * returns the offset following the entry, or 0 if there are no more entries
+ */
+int dc_readdir(int dir, int offset, DIR_ENTRY *dir_entry);
+
+/**
+ * keeps track of the current offset in the root directory and stores the next
+ * file in the listing in filename
+ * 
+ * any modification to the root directory (inserting, removing) will restart
+ * the listing from the beginning
+ * 
+ * returns 0 if the end of the list is reached at which point the point will
+ * restart the listing at the beginning
+ */
+int dc_getnextfilename(char *filename);
@@ -2,6 +2,7 @@
 #include <stdlib.h> 
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <time.h>
 #include "disk_emu.h"
 
@@ -19,6 +20,45 @@ int close_disk()
     if(NULL != fp)
     {
         fclose(fp);
+        fp = NULL;
+    }
+    return 0;
+}
+
+/*--------------------------------------------------------------*/
+/*Makes every block written so far durable. writes are buffered */
+/*by the operating system until then                            */
+/*--------------------------------------------------------------*/
+int sync_disk()
+{
+    if (NULL == fp)
+        return -1;
+    return fdatasync(fileno(fp));
+}
+
+/*----------------------------------------------------------------*/
+/*Reads or writes length bytes at offset, carrying on after short */
+/*transfers. Returns 0 on success, -1 on failure or past the end  */
+/*of the file                                                     */
+/*----------------------------------------------------------------*/
+static int transfer(int is_write, char *buf, size_t length, off_t offset)
+{
+    while (length > 0)
+    {
+        ssize_t n;
+        if (is_write)
+            n = pwrite(fileno(fp), buf, length, offset);
+        else
+            n = pread(fileno(fp), buf, length, offset);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        buf += n;
+        length -= n;
+        offset += n;
     }
     return 0;
 }
@@ -59,6 +99,9 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
             fputc(0, fp);
         }
     }
+
+    /*Blocks are accessed through the file descriptor from now on*/
+    fflush(fp);
     return 0;
 }
 /*----------------------------*/
@@ -95,13 +138,10 @@ int init_disk(char *filename, int block_size, int num_blocks)
 /*-------------------------------------------------------------------*/
 int read_blocks(int start_address, int nblocks, void *buffer)
 {
-    int i, j, e, s;
+    int i, e, s;
     e = 0;
     s = 0;
 
-    /*Sets up a temporary buffer*/
-    void* blockRead = (void*) malloc(BLOCK_SIZE);
-
     /*Checks that the data requested is within the range of addresses of the disk*/
     if (start_address + nblocks > MAX_BLOCK)
     {
@@ -109,26 +149,21 @@ int read_blocks(int start_address, int nblocks, void *buffer)
         return -1;
     }
 
-    /*Goto the data requested from the disk*/
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
-
     /*For every block requested*/
     for (i = 0; i < nblocks; ++i)
     {
         /*Pause until the latency duration is elapsed*/
         // usleep(L);
 
-        s++;
-        fread(blockRead, BLOCK_SIZE, 1, fp);
-
-       for (j = 0; j < BLOCK_SIZE; j++)
-        {
-            memcpy(buffer+(i*BLOCK_SIZE), blockRead, BLOCK_SIZE);  
-        }
+        /*Blocks are read straight into the caller's buffer. pread doesn't*/
+        /*move a shared file position, so threads can read at the same time*/
+        if (transfer(0, (char*)buffer+(i*BLOCK_SIZE), BLOCK_SIZE,
+                (off_t)(start_address + i) * BLOCK_SIZE) < 0)
+            e--;
+        else
+            s++;
     }
 
-    free(blockRead);
-
 
     /*If no failure return the number of blocks read, else return the negative number of failures*/
     if (e == 0)
@@ -146,8 +181,6 @@ int write_blocks(int start_address, int nblocks, void *buffer)
     e = 0;
     s = 0;
 
-    void* blockWrite = (void*) malloc(BLOCK_SIZE);
-
     /*Checks that the data requested is within the range of addresses of the disk*/
     if (start_address + nblocks > MAX_BLOCK)
     {
@@ -155,22 +188,19 @@ int write_blocks(int start_address, int nblocks, void *buffer)
         return -1;
     }
 
-    /*Goto where the data is to be written on the disk*/        
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
-
     /*For every block requested*/        
     for (i = 0; i < nblocks; ++i)
     {
         /*Pause until the latency duration is elapsed*/
         usleep(L);
 
-        memcpy(blockWrite, buffer+(i*BLOCK_SIZE), BLOCK_SIZE);
-
-        fwrite(blockWrite, BLOCK_SIZE, 1, fp);
-        fflush(fp);
-        s++;
+        /*pwrite goes straight to the file, there is no stream to flush*/
+        if (transfer(1, (char*)buffer+(i*BLOCK_SIZE), BLOCK_SIZE,
+                (off_t)(start_address + i) * BLOCK_SIZE) < 0)
+            e--;
+        else
+            s++;
     }
-    free(blockWrite);
 
     /*If no failure return the number of blocks written, else return the negative number of failures*/
     if (e == 0)
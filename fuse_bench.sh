@@ -0,0 +1,63 @@
+#!/bin/sh
+# measures the aggregate read and write throughput of the mounted file system
+# with 1, 2, 4 and 8 client processes working on files of their own. the
+# files are overwritten in place and kept from one run to the next
+#
+# usage: ./fuse_bench.sh <mount dir> [workers]
+#
+# the file system is mounted with direct_io so every read reaches it rather
+# than the kernel's page cache, and unmounted at the end
+
+MNT=${1:?usage: $0 <mount dir> [workers]}
+WORKERS=${2:-8}
+FILE_KB=192 # a file can hold at most 268 KiB
+ROUNDS=20
+
+./braedon_mcdonald_sfs "$MNT" -o direct_io -o workers="$WORKERS" || exit 1
+trap 'fusermount -u "$MNT"' EXIT
+sleep 1
+
+now() {
+    date +%s.%N
+}
+
+# prints the aggregate throughput in MiB/s of the given number of clients
+# running the given command, which is passed the client's file
+run() {
+    clients=$1
+    shift
+    start=$(now)
+    i=0
+    while [ $i -lt "$clients" ]; do
+        "$@" "$MNT/bench$i" &
+        i=$((i + 1))
+    done
+    wait
+    end=$(now)
+    echo "$clients $start $end" | awk -v kb=$((FILE_KB * ROUNDS)) \
+        '{ printf "%8.2f", $1 * kb / 1024 / ($3 - $2) }'
+}
+
+write_file() {
+    r=0
+    while [ $r -lt $ROUNDS ]; do
+        dd if=/dev/zero of="$1" bs=4k count=$((FILE_KB / 4)) conv=notrunc 2>/dev/null
+        r=$((r + 1))
+    done
+}
+
+read_file() {
+    r=0
+    while [ $r -lt $ROUNDS ]; do
+        dd if="$1" of=/dev/null bs=4k 2>/dev/null
+        r=$((r + 1))
+    done
+}
+
+echo "workers: $WORKERS"
+echo "clients  write MiB/s  read MiB/s"
+for clients in 1 2 4 8; do
+    w=$(run $clients write_file)
+    r=$(run $clients read_file)
+    printf "%7d  %11s  %10s\n" $clients "$w" "$r"
+done
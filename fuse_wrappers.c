@@ -10,10 +10,165 @@
 #include <dirent.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <limits.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include "disk_emu.h"
 #include "sfs_api.h"
+#include "io_sched.h"
 
-#define MAXFILENAME 28
+#define MAXFILENAME 255
+
+// options of our own, the others are passed on to fuse
+struct sfs_options {
+    unsigned int workers;
+    int iostats;
+    int reuse;
+};
+
+static struct fuse_opt sfs_opts[] = {
+    { "workers=%u", offsetof(struct sfs_options, workers), 0 },
+    { "iostats", offsetof(struct sfs_options, iostats), 1 },
+    { "reuse", offsetof(struct sfs_options, reuse), 1 },
+    FUSE_OPT_END
+};
+
+// fuse serves requests on as many threads as it needs, the semaphore bounds
+// how many of them are in the file system at once
+static sem_t workers;
+
+// print the counters of the i/o scheduler when unmounted
+static int print_iostats;
+
+static void core_enter()
+{
+    while (sem_wait(&workers) == -1 && errno == EINTR)
+        ;
+}
+
+static void core_leave()
+{
+    sem_post(&workers);
+}
+
+// files opened through fuse. the file system only lets a file be opened
+// once at a time, so every open of a file shares one descriptor which is
+// closed with the last release. the descriptor is opened and closed without
+// the lock, the file's entry is marked busy meanwhile and other opens of
+// the file wait for it
+typedef struct OPEN_FILE {
+    char path[PATH_MAX];
+    int fd;
+    int refs;
+    int busy; // being opened or closed
+    struct OPEN_FILE *next;
+} OPEN_FILE;
+
+static OPEN_FILE *open_files = NULL;
+static pthread_mutex_t open_files_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t open_files_changed = PTHREAD_COND_INITIALIZER;
+
+// removes the entry from the list and wakes up the opens waiting for it.
+// called with the lock held
+static void file_unlink(OPEN_FILE *f)
+{
+    OPEN_FILE **link;
+
+    for (link = &open_files; *link != f; link = &((*link)->next))
+        ;
+    *link = f->next;
+    free(f);
+    pthread_cond_broadcast(&open_files_changed);
+}
+
+// opens the file, creating it if needed, or takes another reference to the
+// descriptor it is already open with. returns -errno if it can't be opened
+static int file_get(const char *path)
+{
+    OPEN_FILE *f;
+    char filename[PATH_MAX];
+    int fd;
+    int err = 0;
+
+    pthread_mutex_lock(&open_files_lock);
+    while (1) {
+        for (f = open_files; f != NULL && strcmp(f->path, path) != 0;
+                f = f->next)
+            ;
+        if (f == NULL || !f->busy)
+            break;
+        pthread_cond_wait(&open_files_changed, &open_files_lock);
+    }
+
+    if (f != NULL) {
+        f->refs++;
+        fd = f->fd;
+        pthread_mutex_unlock(&open_files_lock);
+        return fd;
+    }
+
+    if ((f = malloc(sizeof(OPEN_FILE))) == NULL) {
+        pthread_mutex_unlock(&open_files_lock);
+        return -ENOMEM;
+    }
+    strcpy(f->path, path);
+    f->fd = -1;
+    f->refs = 1;
+    f->busy = 1;
+    f->next = open_files;
+    open_files = f;
+    pthread_mutex_unlock(&open_files_lock);
+
+    strcpy(filename, path);
+    core_enter();
+    fd = sfs_fopen(filename);
+    if (fd == -1)
+        err = -errno;
+    core_leave();
+
+    pthread_mutex_lock(&open_files_lock);
+    if (fd == -1) {
+        file_unlink(f);
+        fd = err;
+    } else {
+        f->fd = fd;
+        f->busy = 0;
+        pthread_cond_broadcast(&open_files_changed);
+    }
+    pthread_mutex_unlock(&open_files_lock);
+
+    return fd;
+}
+
+// drops a reference taken by file_get. returns -EIO if the descriptor was
+// closed and data buffered in it didn't reach the disk
+static int file_put(int fd)
+{
+    OPEN_FILE *f;
+    int res;
+
+    pthread_mutex_lock(&open_files_lock);
+    for (f = open_files; f != NULL && (f->busy || f->fd != fd); f = f->next)
+        ;
+
+    if (f == NULL || --f->refs > 0) {
+        pthread_mutex_unlock(&open_files_lock);
+        return 0;
+    }
+    f->busy = 1;
+    pthread_mutex_unlock(&open_files_lock);
+
+    core_enter();
+    res = sfs_fclose(fd);
+    core_leave();
+
+    pthread_mutex_lock(&open_files_lock);
+    file_unlink(f);
+    pthread_mutex_unlock(&open_files_lock);
+
+    return (res == -1) ? -EIO : 0;
+}
 
 static int fuse_getattr(const char *path, struct stat *stbuf)
 {
@@ -22,7 +177,8 @@ static int fuse_getattr(const char *path, struct stat *stbuf)
 
     memset(stbuf, 0, sizeof(struct stat));
 
-    if (strcmp(path, "/") == 0) {
+    core_enter();
+    if (sfs_isdir(path) == 1) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
     } else if((size = sfs_getfilesize(path)) != -1) {
@@ -31,6 +187,7 @@ static int fuse_getattr(const char *path, struct stat *stbuf)
         stbuf->st_size = size;
     } else
         res = -ENOENT;
+    core_leave();
 
     return res;
 }
@@ -38,17 +195,41 @@ static int fuse_getattr(const char *path, struct stat *stbuf)
 static int fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
         off_t offset, struct fuse_file_info *fi)
 {
-    char file_name[MAXFILENAME];
-
-    if (strcmp(path, "/") != 0)
+    char file_name[MAXFILENAME + 1];
+    struct stat stbuf;
+    int inode_num, size, is_dir;
+    int cur, next;
+
+    core_enter();
+    if (sfs_isdir(path) != 1) {
+        core_leave();
         return -ENOENT;
+    }
 
-    filler(buf, ".", NULL, 0);
-    filler(buf, "..", NULL, 0);
+    // offsets 1 and 2 are . and .., the files follow at their listing
+    // offset plus 2 so a full buffer can be resumed where it stopped
+    if ((offset < 1 && filler(buf, ".", NULL, 1))
+            || (offset < 2 && filler(buf, "..", NULL, 2))) {
+        core_leave();
+        return 0;
+    }
 
-    while(sfs_getnextfilename(file_name)) {
-        filler(buf, &file_name[1], NULL, 0);
+    // the attributes passed to the filler only give the entry's inode number
+    // and type. the high-level api of fuse 2 has no readdir-plus, the kernel
+    // still calls getattr for each entry, which is a hashed lookup
+    cur = (offset <= 2) ? 0 : offset - 2;
+    while ((next = sfs_readdirplus(path, cur, file_name, &inode_num, &size,
+                    &is_dir)) > 0) {
+        memset(&stbuf, 0, sizeof(struct stat));
+        stbuf.st_ino = inode_num;
+        stbuf.st_mode = is_dir ? S_IFDIR | 0755 : S_IFREG | 0666;
+        stbuf.st_nlink = is_dir ? 2 : 1;
+        stbuf.st_size = size;
+        if (filler(buf, file_name, &stbuf, next + 2))
+            break;
+        cur = next;
     }
+    core_leave();
 
     return 0;
 }
@@ -56,95 +237,155 @@ static int fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 static int fuse_unlink(const char *path)
 {
     int res;
-    char filename[MAXFILENAME];
+    char filename[PATH_MAX];
 
     strcpy(filename, path);
+    core_enter();
     res = sfs_remove(filename);
     if (res == -1)
-        return -errno;
+        res = -errno;
+    core_leave();
 
-    return 0;
+    return res;
 }
 
-static int fuse_open(const char *path, struct fuse_file_info *fi)
+static int fuse_mkdir(const char *path, mode_t mode)
 {
+    char filename[PATH_MAX];
+
     int res;
-    char filename[MAXFILENAME];
 
     strcpy(filename, path);
+    core_enter();
+    res = sfs_mkdir(filename);
+    if (res == -1)
+        res = -errno;
+    core_leave();
+
+    return res;
+}
 
-    res = sfs_fopen(filename);
+static int fuse_rmdir(const char *path)
+{
+    char filename[PATH_MAX];
+
+    int res;
+
+    strcpy(filename, path);
+    core_enter();
+    res = sfs_rmdir(filename);
     if (res == -1)
-        return -errno;
+        res = -errno;
+    core_leave();
 
-    sfs_fclose(res);
-    return 0;
+    return res;
 }
 
-static int fuse_read(const char *path, char *buf, size_t size, off_t offset,
-        struct fuse_file_info *fi)
+// the descriptor shared by every open of the file is kept in fi->fh until
+// it is released
+static int fuse_open(const char *path, struct fuse_file_info *fi)
 {
     int fd;
-    int res;
 
-    char filename[MAXFILENAME];
+    fd = file_get(path);
+    if (fd < 0)
+        return fd;
 
-    strcpy(filename, path);
+    fi->fh = fd;
+    return 0;
+}
 
-    fd = sfs_fopen(filename);
-    if (fd == -1)
-        return -errno;
+// fuse ignores what release returns, an error closing the file is only
+// seen by the flush before it
+static int fuse_release(const char *path, struct fuse_file_info *fi)
+{
+    return file_put(fi->fh);
+}
 
-    if(sfs_frseek(fd, offset) == -1)
-        return -errno;
+static int fuse_flush(const char *path, struct fuse_file_info *fi)
+{
+    int res;
+
+    core_enter();
+    res = sfs_fflush(fi->fh);
+    core_leave();
 
-    res = sfs_fread(fd, buf, size);
+    // the descriptor is valid, the buffered data didn't reach the disk
     if (res == -1)
-        return -errno;
+        return -EIO;
 
-    sfs_fclose(fd);
-    return res;
+    return 0;
 }
 
-static int fuse_write(const char *path, const char *buf, size_t size,
-        off_t offset, struct fuse_file_info *fi)
+static int fuse_fsync(const char *path, int isdatasync,
+        struct fuse_file_info *fi)
 {
-    int fd;
     int res;
 
-    char filename[MAXFILENAME];
+    core_enter();
+    res = sfs_fsync(fi->fh);
+    core_leave();
+    if (res == -1)
+        return -EIO;
 
-    strcpy(filename, path);
+    return 0;
+}
 
-    fd = sfs_fopen(filename);
-    if (fd == -1)
-        return -errno;
+static int fuse_read(const char *path, char *buf, size_t size, off_t offset,
+        struct fuse_file_info *fi)
+{
+    int res;
 
-    if(sfs_fwseek(fd, offset) == -1)
-        return -errno;
+    core_enter();
+    res = sfs_pread(fi->fh, buf, size, offset);
+    core_leave();
+    if (res == -1)
+        return -EBADF;
+
+    return res;
+}
 
-    res = sfs_fwrite(fd, buf, size);
+static int fuse_write(const char *path, const char *buf, size_t size,
+        off_t offset, struct fuse_file_info *fi)
+{
+    int res;
+
+    core_enter();
+    res = sfs_pwrite(fi->fh, buf, size, offset);
+    core_leave();
     if (res == -1)
-        return -errno;
+        return -EBADF;
 
-    sfs_fclose(fd);
     return res;
 }
 
 static int fuse_truncate(const char *path, off_t size)
 {
-    char filename[MAXFILENAME];
     int fd;
+    int res;
+    int put_res;
 
-    strcpy(filename, path);
+    // opening the file would create it
+    core_enter();
+    res = sfs_isdir(path);
+    core_leave();
+    if (res == -1)
+        return -ENOENT;
+    if (res == 1)
+        return -EISDIR;
 
-    fd = sfs_remove(filename);
-    if (fd == -1)
-        return -errno;
+    fd = file_get(path);
+    if (fd < 0)
+        return fd;
 
-    fd = sfs_fopen(filename);
-    sfs_fclose(fd);
-    return 0;
+    core_enter();
+    res = sfs_ftruncate(fd, size);
+    if (res == -1)
+        res = -errno;
+    core_leave();
+    put_res = file_put(fd);
+
+    return (res == 0) ? put_res : res;
 }
 
 static int fuse_access(const char *path, int mask)
@@ -159,32 +400,77 @@ static int fuse_mknod(const char *path, mode_t mode, dev_t rdev)
 
 static int fuse_create (const char *path, mode_t mode, struct fuse_file_info *fp)
 {
-    char filename[MAXFILENAME];
     int fd;
 
-    strcpy(filename, path);
-    fd = sfs_fopen(filename);
+    fd = file_get(path);
+    if (fd < 0)
+        return fd;
 
-    sfs_fclose(fd);
+    fp->fh = fd;
     return 0;
 }
 
+static void fuse_destroy(void *private_data)
+{
+    IO_STATS stats;
+
+    sfs_unmount();
+    if (!print_iostats)
+        return;
+
+    io_stats(&stats);
+    fprintf(stderr, "i/o requests: %ld, disk accesses: %ld\n",
+            stats.requests, stats.dispatches);
+    if (stats.requests > 0) {
+        fprintf(stderr, "merge rate: %.1f%%\n",
+                100.0 * stats.merged / stats.requests);
+        fprintf(stderr, "dispatch latency: mean %.1f us, max %.1f us\n",
+                1e6 * stats.total_latency / stats.requests,
+                1e6 * stats.max_latency);
+    }
+    fprintf(stderr, "queue depth: max %d\n", stats.max_queue_depth);
+    fprintf(stderr, "barriers: %ld\n", stats.barriers);
+}
+
 static struct fuse_operations xmp_oper = {
     .getattr = fuse_getattr,
     .readdir = fuse_readdir,
     .mknod = fuse_mknod,
     .unlink = fuse_unlink,
+    .mkdir = fuse_mkdir,
+    .rmdir = fuse_rmdir,
     .truncate = fuse_truncate,
     .open = fuse_open,
+    .release = fuse_release,
+    .flush = fuse_flush,
+    .fsync = fuse_fsync,
     .read = fuse_read,
     .write = fuse_write,
     .access = fuse_access,
     .create = fuse_create,
+    .destroy = fuse_destroy,
 };
 
 int main(int argc, char *argv[])
 {
-    mksfs(1);
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct sfs_options options = { 0 };
+    int res;
+
+    if (fuse_opt_parse(&args, &options, sfs_opts, NULL) == -1)
+        return 1;
 
-    return fuse_main(argc, argv, &xmp_oper, NULL);
+    // by default as many requests are served at once as there are cpus
+    if (options.workers == 0)
+        options.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    sem_init(&workers, 0, options.workers);
+    print_iostats = options.iostats;
+
+    // the disk is formatted unless it is kept from the previous mount
+    mksfs(!options.reuse);
+
+    // fuse runs its multithreaded loop unless -s is given
+    res = fuse_main(args.argc, args.argv, &xmp_oper, NULL);
+    fuse_opt_free_args(&args);
+    return res;
 }
@@ -0,0 +1,270 @@
+#include "io_sched.h"
+#include "disk_emu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef struct IO_REQUEST {
+    int write;
+    int address;
+    int nblocks;
+    char *buf;
+    int done;
+    int failed;
+    void (*callback)(void *arg, int failed); // NULL if someone waits for it
+    void *arg;
+    struct timespec submitted;
+    struct IO_REQUEST *next;
+} IO_REQUEST;
+
+// requests waiting to be dispatched, sorted by address
+static IO_REQUEST *pending = NULL;
+// address the elevator sweeps up from
+static int sweep = 0;
+// requests submitted and not completed yet
+static int outstanding = 0;
+static IO_STATS stats;
+
+// guards everything above. workers wait on work, the threads waiting for
+// their request to complete or for the queue to empty wait on completed
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t completed = PTHREAD_COND_INITIALIZER;
+static int started = 0;
+
+static double elapsed(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static void submit(IO_REQUEST *req)
+{
+    clock_gettime(CLOCK_MONOTONIC, &(req->submitted));
+    req->done = 0;
+    req->failed = 0;
+
+    pthread_mutex_lock(&io_lock);
+    IO_REQUEST **link = &pending;
+    while (*link != NULL && (*link)->address <= req->address)
+        link = &((*link)->next);
+    req->next = *link;
+    *link = req;
+
+    outstanding++;
+    stats.requests++;
+    stats.queue_depth++;
+    if (stats.queue_depth > stats.max_queue_depth)
+        stats.max_queue_depth = stats.queue_depth;
+
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&io_lock);
+}
+
+// takes the next request in elevator order off the queue, along with the
+// ones following it that it can be merged with. returns how many were taken
+static int take_batch(IO_REQUEST **batch)
+{
+    IO_REQUEST **link = &pending;
+    while (*link != NULL && (*link)->address < sweep)
+        link = &((*link)->next);
+
+    // nothing left above the sweep, start again from the lowest address
+    if (*link == NULL)
+        link = &pending;
+
+    IO_REQUEST *req = *link;
+    int n = 0;
+    int nblocks = 0;
+    do
+    {
+        *link = req->next;
+        batch[n++] = req;
+        nblocks += req->nblocks;
+
+        double latency = elapsed(&(req->submitted));
+        stats.total_latency += latency;
+        if (latency > stats.max_latency)
+            stats.max_latency = latency;
+
+        req = *link;
+    } while (req != NULL && req->write == batch[0]->write
+            && req->address == batch[0]->address + nblocks
+            && nblocks + req->nblocks <= IO_MAX_MERGE);
+
+    sweep = batch[0]->address + nblocks;
+    stats.queue_depth -= n;
+    stats.dispatches++;
+    stats.merged += n - 1;
+    return n;
+}
+
+static void *worker(void *arg)
+{
+    // merged requests are read or written through a buffer covering them all
+    char *merge_buf = malloc(IO_MAX_MERGE * BLOCK_SIZE);
+    IO_REQUEST *batch[IO_MAX_MERGE];
+    if (merge_buf == NULL)
+    {
+        printf("could not allocate an i/o worker's buffer\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&io_lock);
+    while (1)
+    {
+        while (pending == NULL)
+            pthread_cond_wait(&work, &io_lock);
+
+        int n = take_batch(batch);
+        pthread_mutex_unlock(&io_lock);
+
+        int address = batch[0]->address;
+        int write = batch[0]->write;
+        int nblocks = 0;
+        int failed;
+
+        if (n == 1)
+        {
+            nblocks = batch[0]->nblocks;
+            if (write)
+                failed = write_blocks(address, nblocks, batch[0]->buf) < 0;
+            else
+                failed = read_blocks(address, nblocks, batch[0]->buf) < 0;
+        }
+        else if (write)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                memcpy(merge_buf + nblocks * BLOCK_SIZE, batch[i]->buf, batch[i]->nblocks * BLOCK_SIZE);
+                nblocks += batch[i]->nblocks;
+            }
+            failed = write_blocks(address, nblocks, merge_buf) < 0;
+        }
+        else
+        {
+            for (int i = 0; i < n; i++)
+                nblocks += batch[i]->nblocks;
+            failed = read_blocks(address, nblocks, merge_buf) < 0;
+
+            char *src = merge_buf;
+            for (int i = 0; i < n; i++)
+            {
+                memcpy(batch[i]->buf, src, batch[i]->nblocks * BLOCK_SIZE);
+                src += batch[i]->nblocks * BLOCK_SIZE;
+            }
+        }
+
+        // asynchronous requests are completed here, the others by the
+        // threads waiting for them. a waiting thread's request is gone as
+        // soon as it sees it done
+        for (int i = 0; i < n; i++)
+        {
+            if (batch[i]->callback != NULL)
+            {
+                batch[i]->callback(batch[i]->arg, failed);
+                free(batch[i]);
+                batch[i] = NULL;
+            }
+        }
+
+        pthread_mutex_lock(&io_lock);
+        for (int i = 0; i < n; i++)
+        {
+            if (batch[i] != NULL)
+            {
+                batch[i]->failed = failed;
+                batch[i]->done = 1;
+            }
+        }
+        outstanding -= n;
+        pthread_cond_broadcast(&completed);
+    }
+    return NULL;
+}
+
+void io_init()
+{
+    pthread_mutex_lock(&io_lock);
+    if (!started)
+    {
+        for (int i = 0; i < IO_WORKERS; i++)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, worker, NULL) != 0)
+            {
+                printf("could not start the i/o workers\n");
+                exit(1);
+            }
+            pthread_detach(thread);
+        }
+        started = 1;
+    }
+
+    while (outstanding > 0)
+        pthread_cond_wait(&completed, &io_lock);
+    pthread_mutex_unlock(&io_lock);
+}
+
+// submits the request and waits for it to complete
+static int submit_wait(IO_REQUEST *req)
+{
+    req->callback = NULL;
+    submit(req);
+
+    pthread_mutex_lock(&io_lock);
+    while (!req->done)
+        pthread_cond_wait(&completed, &io_lock);
+    pthread_mutex_unlock(&io_lock);
+
+    return req->failed ? -1 : 0;
+}
+
+int io_read(int address, int nblocks, void *buf)
+{
+    IO_REQUEST req = { .write = 0, .address = address, .nblocks = nblocks, .buf = buf };
+    return submit_wait(&req);
+}
+
+int io_write(int address, int nblocks, const void *buf)
+{
+    IO_REQUEST req = { .write = 1, .address = address, .nblocks = nblocks, .buf = (char*) buf };
+    return submit_wait(&req);
+}
+
+int io_barrier()
+{
+    pthread_mutex_lock(&io_lock);
+    stats.barriers++;
+    pthread_mutex_unlock(&io_lock);
+
+    return sync_disk() < 0 ? -1 : 0;
+}
+
+void io_read_async(int address, void *buf, void (*done)(void *arg, int failed), void *arg)
+{
+    IO_REQUEST *req = malloc(sizeof(IO_REQUEST));
+    if (req == NULL)
+    {
+        done(arg, 1);
+        return;
+    }
+
+    req->write = 0;
+    req->address = address;
+    req->nblocks = 1;
+    req->buf = buf;
+    req->callback = done;
+    req->arg = arg;
+    submit(req);
+}
+
+void io_stats(IO_STATS *s)
+{
+    pthread_mutex_lock(&io_lock);
+    *s = stats;
+    pthread_mutex_unlock(&io_lock);
+}
@@ -0,0 +1,75 @@
+/**
+ * api for the block i/o scheduler
+ *
+ * every disk access goes through a queue served by a small pool of worker
+ * threads. pending requests are kept sorted by block address and the workers
+ * take them in elevator order, sweeping up the disk and wrapping around.
+ * requests of the same kind for consecutive blocks are merged into a single
+ * access of the disk, and the workers serve requests for different blocks in
+ * parallel
+ *
+ * io_read and io_write wait for their request to complete. io_read_async
+ * queues a read and returns at once, which lets the block cache read ahead.
+ * requests for the same blocks aren't ordered with each other, callers order
+ * their writes to a block
+ *
+ * a completed write may still be buffered by the operating system. it is
+ * durable once io_barrier returns, which the journal calls where the order
+ * in which blocks reach the disk matters
+ */
+
+#include "common.h"
+
+#define IO_WORKERS 4
+#define IO_MAX_MERGE 32 // most blocks one merged access of the disk covers
+
+typedef struct IO_STATS {
+    long requests; // requests submitted
+    long dispatches; // accesses of the disk, each serving one or more requests
+    long merged; // requests served by an access dispatched for another one
+    int queue_depth; // requests waiting to be dispatched
+    int max_queue_depth;
+    double total_latency; // seconds between submitting and dispatching, summed
+    double max_latency;
+    long barriers; // calls to io_barrier
+} IO_STATS;
+
+/**
+ * starts the workers the first time it is called. afterwards it waits for
+ * every submitted request to complete, so the disk can be switched
+ */
+void io_init();
+
+/**
+ * reads the given blocks from disk into buf
+ *
+ * returns 0 on success, -1 on failure
+ */
+int io_read(int address, int nblocks, void *buf);
+
+/**
+ * writes buf to the given blocks on disk
+ *
+ * returns 0 on success, -1 on failure
+ */
+int io_write(int address, int nblocks, const void *buf);
+
+/**
+ * makes every write completed before the call durable
+ *
+ * returns 0 on success, -1 on failure
+ */
+int io_barrier();
+
+/**
+ * queues a read of one block into buf and returns without waiting for it.
+ * done is called from a worker once the block is read, with arg and whether
+ * the read failed
+ */
+void io_read_async(int address, void *buf, void (*done)(void *arg, int failed), void *arg);
+
+/**
+ * copies the counters of the scheduler to stats. merged / requests is the
+ * merge rate and total_latency / requests the mean dispatch latency
+ */
+void io_stats(IO_STATS *stats);
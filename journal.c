@@ -0,0 +1,637 @@
+#include "journal.h"
+#include "block_cache.h"
+#include "io_sched.h"
+#include "sfs_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define JN_MAGIC 0x4A524E4C
+#define JN_MAX_BLOCKS 384 // most blocks a transaction logs
+#define JN_HANDLE_BLOCKS 24 // most blocks an operation logs
+#define JN_COMMIT_BLOCKS 128 // a transaction this large is committed at once
+#define JN_ADDRESSES_PER_BLOCK (BLOCK_SIZE / sizeof(int))
+#define JN_CHECKPOINT_RUN 64 // most blocks written home at once
+
+// first block of the journal area, the log takes the rest of it
+typedef struct JN_HEADER {
+    int magic;
+    int seq; // sequence number of the transaction at the start of the log
+} JN_HEADER;
+
+// a transaction in the log is this block, blocks holding the addresses of
+// the logged blocks then of the revoked ones, the logged blocks and a commit
+// block. the transaction was written entirely if the commit block's checksum
+// matches the blocks before it
+typedef struct JN_DESCRIPTOR {
+    int magic;
+    int seq;
+    int nblocks;
+    int nrevoked;
+} JN_DESCRIPTOR;
+
+typedef struct JN_COMMIT {
+    int magic;
+    int seq;
+    unsigned int checksum;
+} JN_COMMIT;
+
+typedef struct JN_TXN {
+    int seq;
+    int handles; // operations in progress
+    int locked; // being committed, no operation may start in it
+    int nblocks;
+    int addresses[JN_MAX_BLOCKS];
+    char *blocks[JN_MAX_BLOCKS]; // latest contents of the logged blocks
+    short slots[NUM_BLOCKS]; // index + 1 of each logged address, 0 if absent
+    int *revoked; // freed blocks whose copies in the log are obsolete
+    int nrevoked;
+    int revoked_size;
+    int *freed; // blocks released to the free map after the commit
+    int nfreed;
+    int freed_size;
+} JN_TXN;
+
+// the running transaction takes new changes while the other one, if any,
+// is being committed
+static JN_TXN txns[2];
+static JN_TXN *running = &(txns[0]);
+static JN_TXN *committing = NULL;
+static int committed_seq;
+
+// committed blocks not written to their home location yet
+static char *checkpoint[NUM_BLOCKS];
+// set for blocks of which the log may hold a copy
+static char maybe_logged[NUM_BLOCKS];
+
+static int mounted = 0;
+// a write of the log or of a checkpoint failed. the disk is left as of the
+// last transaction committed, later changes are kept in memory only
+static int aborted = 0;
+static int commit_requested = 0;
+static int checkpoint_requested = 0;
+static int checkpoints = 0; // checkpoints written, to wait for one
+
+// guards everything above. only the committer changes committing and the
+// checkpointed blocks, it reads them without the lock
+static pthread_mutex_t jn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t commit_wanted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t handles_done = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t unlocked = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t committed = PTHREAD_COND_INITIALIZER;
+static int started = 0;
+
+// only used by the committer, and by recovery before it has work
+static int log_head; // next free block of the log, from the journal's start
+static char log_buf[JOURNAL_LENGTH * BLOCK_SIZE];
+static char run_buf[JN_CHECKPOINT_RUN * BLOCK_SIZE];
+static int revoked_seq[NUM_BLOCKS];
+
+// depth of the jn_begin calls of the thread
+static __thread int depth = 0;
+
+static unsigned int checksum(const char *buf, int length)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) buf[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// appends an address to a growable array
+static void append(int **array, int *n, int *size, int address)
+{
+    if (*n == *size)
+    {
+        int new_size = (*size == 0) ? 64 : *size * 2;
+        int *new_array = realloc(*array, new_size * sizeof(int));
+        if (new_array == NULL)
+        {
+            printf("error: could not grow a journal transaction\n");
+            exit(1);
+        }
+        *array = new_array;
+        *size = new_size;
+    }
+    (*array)[(*n)++] = address;
+}
+
+// blocks of the log a transaction takes
+static int txn_length(int nblocks, int nrevoked)
+{
+    return 1 + (nblocks + JN_ADDRESSES_PER_BLOCK - 1) / JN_ADDRESSES_PER_BLOCK
+        + (nrevoked + JN_ADDRESSES_PER_BLOCK - 1) / JN_ADDRESSES_PER_BLOCK
+        + nblocks + 1;
+}
+
+// returns -1 if the header could not be written
+static int write_header(int seq)
+{
+    char block_buf[BLOCK_SIZE];
+    memset(block_buf, 0, BLOCK_SIZE);
+    ((JN_HEADER*) block_buf)->magic = JN_MAGIC;
+    ((JN_HEADER*) block_buf)->seq = seq;
+    return io_write(JOURNAL_ADDRESS, 1, block_buf);
+}
+
+// stops writing to the disk once a write of the committer failed
+static void abort_journal()
+{
+    pthread_mutex_lock(&jn_lock);
+    if (!aborted)
+        printf("error: could not write the journal, changes no longer reach the disk\n");
+    aborted = 1;
+    pthread_mutex_unlock(&jn_lock);
+}
+
+// reads blocks of the log into log_buf while recovering, which can't go on
+// without them
+static void recovery_read(int pos, int nblocks)
+{
+    if (io_read(JOURNAL_ADDRESS + pos, nblocks, log_buf) < 0)
+    {
+        printf("error: could not read the journal\n");
+        exit(1);
+    }
+}
+
+// writes every committed block to its home location and empties the log,
+// whose first transaction will be seq
+static void write_checkpoint(int seq)
+{
+    // the committed blocks stay in memory once the journal is aborted. the
+    // log on disk still holds what they were last committed as
+    if (aborted)
+        return;
+
+    int address = 0;
+    while (address < NUM_BLOCKS)
+    {
+        // runs of consecutive blocks are written at once
+        int n = 0;
+        while (address + n < NUM_BLOCKS && n < JN_CHECKPOINT_RUN
+                && checkpoint[address + n] != NULL)
+        {
+            memcpy(run_buf + n * BLOCK_SIZE, checkpoint[address + n], BLOCK_SIZE);
+            n++;
+        }
+
+        if (n > 0 && io_write(address, n, run_buf) < 0)
+        {
+            abort_journal();
+            return;
+        }
+        address += (n > 0) ? n : 1;
+    }
+
+    // the log is only emptied once the blocks are durable at home. the
+    // header itself is made durable by the next commit's barrier
+    if (io_barrier() < 0 || write_header(seq) < 0)
+    {
+        abort_journal();
+        return;
+    }
+    log_head = 1;
+
+    pthread_mutex_lock(&jn_lock);
+    for (address = 0; address < NUM_BLOCKS; address++)
+    {
+        free(checkpoint[address]);
+        checkpoint[address] = NULL;
+    }
+
+    // the log is empty, only blocks of the transactions not committed yet
+    // will have copies in it
+    memset(maybe_logged, 0, sizeof(maybe_logged));
+    for (int i = 0; i < running->nblocks; i++)
+        maybe_logged[running->addresses[i]] = 1;
+    if (committing != NULL)
+    {
+        for (int i = 0; i < committing->nblocks; i++)
+            maybe_logged[committing->addresses[i]] = 1;
+    }
+    pthread_mutex_unlock(&jn_lock);
+}
+
+// writes the transaction to the log in one go, making room first if needed
+static void write_txn(JN_TXN *t)
+{
+    int length = txn_length(t->nblocks, t->nrevoked);
+    memset(log_buf, 0, length * BLOCK_SIZE);
+
+    JN_DESCRIPTOR *descriptor = (JN_DESCRIPTOR*) log_buf;
+    descriptor->magic = JN_MAGIC;
+    descriptor->seq = t->seq;
+    descriptor->nblocks = t->nblocks;
+    descriptor->nrevoked = t->nrevoked;
+
+    int *entries = (int*) (log_buf + BLOCK_SIZE);
+    memcpy(entries, t->addresses, t->nblocks * sizeof(int));
+    entries += (t->nblocks + JN_ADDRESSES_PER_BLOCK - 1) / JN_ADDRESSES_PER_BLOCK
+        * JN_ADDRESSES_PER_BLOCK;
+    memcpy(entries, t->revoked, t->nrevoked * sizeof(int));
+
+    char *data = log_buf + (length - 1 - t->nblocks) * BLOCK_SIZE;
+    for (int i = 0; i < t->nblocks; i++)
+        memcpy(data + i * BLOCK_SIZE, t->blocks[i], BLOCK_SIZE);
+
+    JN_COMMIT *commit = (JN_COMMIT*) (log_buf + (length - 1) * BLOCK_SIZE);
+    commit->magic = JN_MAGIC;
+    commit->seq = t->seq;
+    commit->checksum = checksum(log_buf, (length - 1) * BLOCK_SIZE);
+
+    if (log_head + length > JOURNAL_LENGTH)
+        write_checkpoint(t->seq);
+    if (aborted)
+        return;
+
+    // the data written in place by the transaction's operations reaches the
+    // disk before the transaction, which is durable once committed. a crash
+    // while writing it leaves a transaction whose checksum doesn't match
+    if (io_barrier() < 0 || io_write(JOURNAL_ADDRESS + log_head, length, log_buf) < 0
+            || io_barrier() < 0)
+    {
+        abort_journal();
+        return;
+    }
+    log_head += length;
+}
+
+// commits the running transaction. called by the committer with the lock
+// held, which it releases while writing
+static void commit_running()
+{
+    JN_TXN *t = running;
+
+    // operations in the transaction finish, new ones wait for the next one
+    t->locked = 1;
+    while (t->handles > 0)
+        pthread_cond_wait(&handles_done, &jn_lock);
+
+    committing = t;
+    running = (t == &(txns[0])) ? &(txns[1]) : &(txns[0]);
+    running->seq = t->seq + 1;
+    pthread_cond_broadcast(&unlocked);
+    pthread_mutex_unlock(&jn_lock);
+
+    write_txn(t);
+
+    // a block logged by the transaction that also revokes it was logged
+    // after being freed and reused, its copy stays
+    pthread_mutex_lock(&jn_lock);
+    for (int i = 0; i < t->nrevoked; i++)
+    {
+        free(checkpoint[t->revoked[i]]);
+        checkpoint[t->revoked[i]] = NULL;
+    }
+    for (int i = 0; i < t->nblocks; i++)
+    {
+        int address = t->addresses[i];
+        free(checkpoint[address]);
+        checkpoint[address] = t->blocks[i];
+        t->blocks[i] = NULL;
+        t->slots[address] = 0;
+    }
+    committing = NULL;
+    committed_seq = t->seq;
+    pthread_mutex_unlock(&jn_lock);
+
+    // the blocks freed by the transaction can be reused now. those of a
+    // transaction that didn't reach the disk are still referenced there
+    for (int i = 0; i < t->nfreed && !aborted; i++)
+        fm_release(t->freed[i]);
+
+    pthread_mutex_lock(&jn_lock);
+    t->nblocks = 0;
+    t->nrevoked = 0;
+    t->nfreed = 0;
+    t->locked = 0;
+    pthread_cond_broadcast(&committed);
+}
+
+static void *committer(void *arg)
+{
+    pthread_mutex_lock(&jn_lock);
+    while (1)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += JN_COMMIT_SECONDS;
+
+        while (!commit_requested && !checkpoint_requested)
+        {
+            if (pthread_cond_timedwait(&commit_wanted, &jn_lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+        commit_requested = 0;
+
+        if (mounted && (running->nblocks > 0 || running->nrevoked > 0 || running->nfreed > 0))
+            commit_running();
+
+        if (checkpoint_requested)
+        {
+            int seq = running->seq;
+            checkpoint_requested = 0;
+            pthread_mutex_unlock(&jn_lock);
+            write_checkpoint(seq);
+            pthread_mutex_lock(&jn_lock);
+            checkpoints++;
+            pthread_cond_broadcast(&committed);
+        }
+    }
+    return NULL;
+}
+
+// starts the committer the first time, and starts with an empty log whose
+// first transaction is seq
+static void start(int seq)
+{
+    pthread_mutex_lock(&jn_lock);
+    if (!started)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, committer, NULL) != 0)
+        {
+            printf("could not start the journal committer\n");
+            exit(1);
+        }
+        pthread_detach(thread);
+        started = 1;
+    }
+
+    running = &(txns[0]);
+    running->seq = seq;
+    committed_seq = seq - 1;
+    log_head = 1;
+    memset(maybe_logged, 0, sizeof(maybe_logged));
+    mounted = 1;
+    pthread_mutex_unlock(&jn_lock);
+}
+
+void jn_format()
+{
+    if (write_header(1) < 0)
+    {
+        printf("error: could not write the journal header\n");
+        exit(1);
+    }
+    start(1);
+}
+
+void jn_recover(int readonly)
+{
+    JN_HEADER *header = (JN_HEADER*) log_buf;
+    recovery_read(0, 1);
+    if (header->magic != JN_MAGIC)
+    {
+        printf("error reading magic number in journal header\n");
+        exit(1);
+    }
+
+    // find the transactions written entirely, and the blocks they revoke
+    int first_seq = header->seq;
+    int seq = first_seq;
+    int pos = 1;
+    memset(revoked_seq, 0, sizeof(revoked_seq));
+    while (pos + 2 <= JOURNAL_LENGTH)
+    {
+        JN_DESCRIPTOR *descriptor = (JN_DESCRIPTOR*) log_buf;
+        recovery_read(pos, 1);
+        if (descriptor->magic != JN_MAGIC || descriptor->seq != seq
+                || descriptor->nblocks < 0 || descriptor->nblocks > JN_MAX_BLOCKS
+                || descriptor->nrevoked < 0 || descriptor->nrevoked > NUM_BLOCKS)
+            break;
+
+        int nblocks = descriptor->nblocks;
+        int nrevoked = descriptor->nrevoked;
+        int length = txn_length(nblocks, nrevoked);
+        if (pos + length > JOURNAL_LENGTH)
+            break;
+
+        recovery_read(pos, length);
+        JN_COMMIT *commit = (JN_COMMIT*) (log_buf + (length - 1) * BLOCK_SIZE);
+        if (commit->magic != JN_MAGIC || commit->seq != seq
+                || commit->checksum != checksum(log_buf, (length - 1) * BLOCK_SIZE))
+            break;
+
+        int *revoked = (int*) (log_buf + BLOCK_SIZE) + (nblocks + JN_ADDRESSES_PER_BLOCK - 1)
+            / JN_ADDRESSES_PER_BLOCK * JN_ADDRESSES_PER_BLOCK;
+        for (int i = 0; i < nrevoked; i++)
+        {
+            if (revoked[i] >= 0 && revoked[i] < NUM_BLOCKS)
+                revoked_seq[revoked[i]] = seq;
+        }
+
+        pos += length;
+        seq++;
+    }
+
+    // write the logged blocks to their home locations in order, skipping
+    // copies revoked by a later transaction. a copy in the transaction
+    // revoking the block was logged after it was freed. read only, they are
+    // kept as committed blocks not written home yet instead
+    pos = 1;
+    for (int s = first_seq; s < seq; s++)
+    {
+        recovery_read(pos, 1);
+        JN_DESCRIPTOR descriptor = *((JN_DESCRIPTOR*) log_buf);
+        int length = txn_length(descriptor.nblocks, descriptor.nrevoked);
+        recovery_read(pos, length);
+
+        int *addresses = (int*) (log_buf + BLOCK_SIZE);
+        char *data = log_buf + (length - 1 - descriptor.nblocks) * BLOCK_SIZE;
+        for (int i = 0; i < descriptor.nblocks; i++)
+        {
+            int address = addresses[i];
+            if (address < 0 || address >= NUM_BLOCKS || revoked_seq[address] > s)
+                continue;
+
+            if (readonly)
+            {
+                char *copy = malloc(BLOCK_SIZE);
+                if (copy == NULL)
+                {
+                    printf("error: could not replay the journal\n");
+                    exit(1);
+                }
+                memcpy(copy, data + i * BLOCK_SIZE, BLOCK_SIZE);
+                free(checkpoint[address]);
+                checkpoint[address] = copy;
+            }
+            else if (io_write(address, 1, data + i * BLOCK_SIZE) < 0)
+            {
+                printf("error: could not replay the journal\n");
+                exit(1);
+            }
+        }
+        pos += length;
+    }
+    if (readonly)
+        return;
+
+    if (io_barrier() < 0 || write_header(seq) < 0 || io_barrier() < 0)
+    {
+        printf("error: could not replay the journal\n");
+        exit(1);
+    }
+    start(seq);
+}
+
+void jn_unmount()
+{
+    pthread_mutex_lock(&jn_lock);
+    if (mounted)
+    {
+        int done = checkpoints;
+        checkpoint_requested = 1;
+        pthread_cond_signal(&commit_wanted);
+        while (checkpoints == done)
+            pthread_cond_wait(&committed, &jn_lock);
+        mounted = 0;
+    }
+    pthread_mutex_unlock(&jn_lock);
+}
+
+void jn_begin()
+{
+    if (depth++ > 0)
+        return;
+
+    // every operation of a transaction may log up to JN_HANDLE_BLOCKS, one
+    // that could overflow it waits for the next one
+    pthread_mutex_lock(&jn_lock);
+    while (running->locked
+            || running->nblocks + (running->handles + 1) * JN_HANDLE_BLOCKS > JN_MAX_BLOCKS)
+    {
+        if (!running->locked)
+        {
+            commit_requested = 1;
+            pthread_cond_signal(&commit_wanted);
+        }
+        pthread_cond_wait(&unlocked, &jn_lock);
+    }
+    running->handles++;
+    pthread_mutex_unlock(&jn_lock);
+}
+
+void jn_end()
+{
+    if (--depth > 0)
+        return;
+
+    pthread_mutex_lock(&jn_lock);
+    running->handles--;
+    if (running->handles == 0)
+        pthread_cond_signal(&handles_done);
+    if (running->nblocks >= JN_COMMIT_BLOCKS)
+    {
+        commit_requested = 1;
+        pthread_cond_signal(&commit_wanted);
+    }
+    pthread_mutex_unlock(&jn_lock);
+}
+
+void jn_write(int address, const void *buf)
+{
+    pthread_mutex_lock(&jn_lock);
+    JN_TXN *t = running;
+    int i = t->slots[address] - 1;
+    if (i == -1)
+    {
+        char *copy = malloc(BLOCK_SIZE);
+        if (copy == NULL || t->nblocks == JN_MAX_BLOCKS)
+        {
+            printf("error: journal transaction overflow\n");
+            exit(1);
+        }
+
+        i = t->nblocks++;
+        t->addresses[i] = address;
+        t->blocks[i] = copy;
+        t->slots[address] = i + 1;
+    }
+    memcpy(t->blocks[i], buf, BLOCK_SIZE);
+    maybe_logged[address] = 1;
+    pthread_mutex_unlock(&jn_lock);
+
+    bc_update(address, buf);
+}
+
+int jn_read(int address, void *buf)
+{
+    const char *block = NULL;
+
+    pthread_mutex_lock(&jn_lock);
+    if (running->slots[address] != 0)
+        block = running->blocks[running->slots[address] - 1];
+    else if (committing != NULL && committing->slots[address] != 0)
+        block = committing->blocks[committing->slots[address] - 1];
+    else
+        block = checkpoint[address];
+
+    if (block != NULL)
+        memcpy(buf, block, BLOCK_SIZE);
+    pthread_mutex_unlock(&jn_lock);
+
+    return (block != NULL) ? 0 : -1;
+}
+
+void jn_freed(int address)
+{
+    pthread_mutex_lock(&jn_lock);
+    JN_TXN *t = running;
+
+    // a copy logged by the running transaction is dropped
+    int i = t->slots[address] - 1;
+    if (i != -1)
+    {
+        free(t->blocks[i]);
+        t->nblocks--;
+        t->addresses[i] = t->addresses[t->nblocks];
+        t->blocks[i] = t->blocks[t->nblocks];
+        t->slots[t->addresses[i]] = i + 1;
+        t->slots[address] = 0;
+    }
+
+    // older copies in the log mustn't be replayed over what the block holds
+    // once it is reused
+    if (maybe_logged[address])
+    {
+        append(&(t->revoked), &(t->nrevoked), &(t->revoked_size), address);
+        maybe_logged[address] = 0;
+    }
+
+    append(&(t->freed), &(t->nfreed), &(t->freed_size), address);
+    pthread_mutex_unlock(&jn_lock);
+}
+
+int jn_commit()
+{
+    pthread_mutex_lock(&jn_lock);
+    int target = running->seq;
+
+    // nothing changed since the last commit, wait for it only. data written
+    // since isn't covered by its barriers, that takes one more
+    int empty = (running->nblocks == 0 && running->nrevoked == 0 && running->nfreed == 0);
+    if (empty)
+        target--;
+
+    while (mounted && committed_seq < target)
+    {
+        commit_requested = 1;
+        pthread_cond_signal(&commit_wanted);
+        pthread_cond_wait(&committed, &jn_lock);
+    }
+    int failed = aborted;
+    pthread_mutex_unlock(&jn_lock);
+
+    if (empty && io_barrier() < 0)
+        failed = 1;
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * api for the metadata journal
+ *
+ * metadata blocks (the super block, the inode table, the free map, directory
+ * blocks, index buckets and indirect blocks) aren't written in place as they
+ * change. each change is a copy of the whole block logged in the running
+ * transaction, which every operation in progress adds to. the changes of an
+ * operation are between jn_begin and jn_end, so they are all in the same
+ * transaction. a thread commits the running transaction every few seconds,
+ * once it grows large or when a commit is asked for, so the changes of many
+ * operations reach the disk in one sequential write to the journal area
+ *
+ * committed blocks are kept in memory and written to their home locations
+ * only when the journal area fills up or the file system is unmounted, at
+ * which point each block is written once whatever the number of changes it
+ * went through. data blocks are written in place before the operation
+ * changing their metadata is committed, so a crash leaves the file system as
+ * of the last committed transaction, which is replayed when it is mounted
+ *
+ * a block freed by a transaction isn't reused before that transaction is
+ * committed. if it was logged before, the transaction records that its old
+ * copies must not be replayed
+ *
+ * if a write of the log or of a checkpoint fails, the journal stops writing
+ * to the disk, which is left as of the last committed transaction. later
+ * changes are kept in memory only and every jn_commit fails
+ */
+
+#include "common.h"
+
+#define JN_COMMIT_SECONDS 5 // longest a change waits to be committed
+
+/**
+ * creates an empty journal on a freshly initialized disk and starts using it
+ */
+void jn_format();
+
+/**
+ * replays the committed transactions found in the journal of the disk to
+ * their home locations and starts using it. must be called once the block
+ * cache is initialized and before anything else is read from the disk
+ *
+ * readonly - 1 to keep the replayed blocks in memory, where reads find them,
+ * without writing anything to the disk. the journal isn't started, so
+ * nothing may be logged
+ */
+void jn_recover(int readonly);
+
+/**
+ * commits every change, writes the blocks to their home locations and stops
+ * using the journal. does nothing if it isn't in use
+ */
+void jn_unmount();
+
+/**
+ * starts an operation, whose changes will be committed together. waits for
+ * room in the running transaction. must be called before taking any of the
+ * file system's locks. calls may nest, only the outermost ones count
+ */
+void jn_begin();
+
+/**
+ * ends an operation started with jn_begin
+ */
+void jn_end();
+
+/**
+ * logs the new contents of a metadata block in the running transaction and
+ * updates the cached copy of the block. writes to one block must be ordered
+ * by the caller
+ */
+void jn_write(int address, const void *buf);
+
+/**
+ * copies to buf the latest contents of the block logged in the journal and
+ * not written to its home location yet
+ *
+ * returns 0 if the block was found, -1 if its home location is up to date
+ */
+int jn_read(int address, void *buf);
+
+/**
+ * records that the block at the given address was freed by the running
+ * transaction. it is released to the free map once the transaction commits
+ */
+void jn_freed(int address);
+
+/**
+ * commits the running transaction and waits until it is durable, along with
+ * every block written before the call. must not be called between jn_begin
+ * and jn_end
+ *
+ * returns 0 on success, -1 if the changes could not be made durable
+ */
+int jn_commit();
@@ -1,193 +1,520 @@
 #include "common.h"
 #include "sfs_api.h"
 #include "disk_emu.h"
-#include "root_dir_cache.h"
+#include "block_cache.h"
+#include "io_sched.h"
+#include "journal.h"
+#include "dir_cache.h"
 #include "sfs_util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+
+// held by every operation on names: looking them up, creating and removing
+// files and directories and listing directories. the directory cache and
+// the allocation of inodes rely on it. reads and writes of open files don't
+// take it, they only lock the inode of the file
+static pthread_mutex_t dir_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// a disk is mounted, sfs_unmount has something to do
+static int mounted = 0;
+
+static void flush_write_buffer(OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr,
+        int write_inode);
 
 void mksfs(int fresh) 
 {
     INODE root_dir_inode;
-    SUPER_BLOCK super_block;
+    SUPER_BLOCK *super_block = &super_block_cache;
+    const unsigned int *used_inodes = NULL;
+
+    // the previous disk is left with every change at its home location, and
+    // its reads and writes complete
+    sfs_unmount();
+    io_init();
 
     if (fresh)
     {
         // init with 8 megabytes of free space
         init_fresh_disk("emulated_disk", BLOCK_SIZE, NUM_BLOCKS);
-
-        // write super block to first block of disk
-        super_block.magic_number = 0xABCD0005;
-        super_block.block_size = BLOCK_SIZE;
-        super_block.fs_size = NUM_BLOCKS;
-        super_block.inode_table_length = INODE_TABLE_LENGTH;
-        super_block.root_dir_inode_num = 0;
-        write_blocks(0, 1, &super_block);
-
-        // initialize inode table cache
-        for (int i = 0; i < 512; i++)
+        bc_init();
+        jn_format();
+        fm_init(NULL);
+
+        memset(super_block, 0, sizeof(SUPER_BLOCK));
+        super_block->magic_number = SFS_MAGIC;
+        super_block->block_size = BLOCK_SIZE;
+        super_block->fs_size = NUM_BLOCKS;
+        super_block->inode_table_length = INODE_TABLE_LENGTH;
+        super_block->root_dir_inode_num = 0;
+
+        // allocate the empty buckets of the root directory's index
+        DIR_INDEX_BUCKET empty_bucket;
+        memset(&empty_bucket, 0, sizeof(DIR_INDEX_BUCKET));
+        for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
         {
-            inode_table_cache[i].valid = 0;
+            super_block->dir_index[i] = fm_allocate(0);
+            if (bc_write(super_block->dir_index[i], &empty_bucket) < 0)
+            {
+                printf("error writing the directory index\n");
+                exit(1);
+            }
         }
+        fm_flush();
+
+        // write super block to first block of disk
+        super_block_to_disk();
+
+        // initialize inode table cache, every block pointer starts unallocated
+        memset(inode_table_cache, 0, sizeof(inode_table_cache));
+
         // write root directory to first entry of inode table cache
+        memset(&root_dir_inode, 0, sizeof(INODE));
         root_dir_inode.valid = 1;
-        root_dir_inode.mode = 0;
+        root_dir_inode.mode = MODE_DIR;
         root_dir_inode.link_count = 1;
         root_dir_inode.uid = 0;
         root_dir_inode.gid = 0;
         root_dir_inode.size = 0;
+        root_dir_inode.free_block = -1;
         inode_table_cache[ROOT_DIR_INODE_NUM] = root_dir_inode;
         // write inode table cache to disk
-        write_blocks(1, INODE_TABLE_LENGTH, inode_table_cache);
+        if (io_write(1, INODE_TABLE_LENGTH, inode_table_cache) < 0)
+        {
+            printf("error writing the inode table\n");
+            exit(1);
+        }
+
+        // the super block and free map are in the journal
+        if (jn_commit() < 0)
+        {
+            printf("error writing the super block\n");
+            exit(1);
+        }
     }
     else
     {
         init_disk("emulated_disk", BLOCK_SIZE, NUM_BLOCKS);
+        bc_init();
+
+        // bring the disk up to date with the committed transactions before
+        // reading anything from it
+        jn_recover(0);
 
         // read super block
         void *super_block_buff = (void*) malloc(BLOCK_SIZE); // 
-        read_blocks(0, 1, super_block_buff);
-        super_block = *((SUPER_BLOCK*) super_block_buff);
+        if (io_read(0, 1, super_block_buff) < 0)
+        {
+            printf("error reading the super block\n");
+            exit(1);
+        }
+        *super_block = *((SUPER_BLOCK*) super_block_buff);
         free(super_block_buff);
 
         // validate super block
-        if (super_block.magic_number != 0xABCD0005)
+        if (super_block->magic_number != SFS_MAGIC)
         {
             printf("error reading magic number in super block\n");
             exit(1);
         }
-        if (super_block.block_size != BLOCK_SIZE)
+        if (super_block->block_size != BLOCK_SIZE)
         {
             printf("super block has wrong block size\n");
             exit(1);
         }
-        if (super_block.fs_size != NUM_BLOCKS)
+        if (super_block->fs_size != NUM_BLOCKS)
         {
             printf("super block has wrong file system size\n");
             exit(1);
         }
-        if (super_block.inode_table_length != INODE_TABLE_LENGTH)
+        if (super_block->inode_table_length != INODE_TABLE_LENGTH)
         {
             printf("super block has wrong inode table length\n");
             exit(1);
         }
-        if (super_block.root_dir_inode_num != ROOT_DIR_INODE_NUM)
+        if (super_block->root_dir_inode_num != ROOT_DIR_INODE_NUM)
         {
             printf("super block has wrong root directory inode number\n");
             exit(1);
         }
+
+        // the summaries of a disk unmounted cleanly are up to date, only
+        // the blocks of the inode table in use are read. otherwise the free
+        // counts and the whole table are read from the disk again
+        if (super_block->clean)
+        {
+            fm_init(super_block->free_blocks);
+            used_inodes = super_block->used_inodes;
+        }
+        else
+        {
+            fm_init(NULL);
+        }
+
+        // the summaries are stale once anything changes. the flag is
+        // cleared in the running transaction before any change is logged,
+        // so every transaction replayed after a crash comes with it
+        super_block->clean = 0;
+        super_block_to_disk();
     }
 
     // cache inode table
-    read_blocks(1, INODE_TABLE_LENGTH, inode_table_cache);
+    load_inode_table(used_inodes);
 
-    // get root inode
-    root_dir_inode = inode_table_cache[super_block.root_dir_inode_num];
-
-    // cache root directory
-    rdc_init(root_dir_inode);
+    // directory entries are read from disk as they are looked up
+    dc_init();
 
     // init open file descriptor table
     init_open_file_descriptor_table();
+    mounted = 1;
+}
+
+void sfs_unmount()
+{
+    SUPER_BLOCK *super_block = &super_block_cache;
+
+    if (!mounted)
+    {
+        return;
+    }
+
+    // data left in the write buffers of files still open is written before
+    // the summaries count its blocks. if any of it failed, the summaries
+    // aren't trusted by the next mount
+    int write_error = 0;
+    for (int fd = 0; fd < get_fd_table_size(); fd++)
+    {
+        OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr = get_fd_entry(fd);
+        if (fde_ptr == NULL)
+            continue;
+
+        jn_begin();
+        inode_wrlock(fde_ptr->inode_num);
+        flush_write_buffer(fde_ptr, 1);
+        write_error |= fde_ptr->write_error;
+        inode_unlock(fde_ptr->inode_num);
+        jn_end();
+    }
+
+    // save the summaries the next mount starts from, the journal then
+    // writes them home along with every other change
+    jn_begin();
+    fm_counts(super_block->free_blocks);
+    memset(super_block->used_inodes, 0, sizeof(super_block->used_inodes));
+    for (int i = 0; i < NUM_INODES; i++)
+    {
+        if (inode_table_cache[i].valid)
+            super_block->used_inodes[i / 32] |= 1u << (i % 32);
+    }
+    super_block->clean = !write_error;
+    super_block_to_disk();
+    jn_end();
+
+    jn_unmount();
+    close_disk();
+    mounted = 0;
 }
 
 // return 1 on success
 int sfs_getnextfilename(char *fname)
 {
-    return rdc_getnextfilename(fname);
+    pthread_mutex_lock(&dir_lock);
+    int retval = dc_getnextfilename(fname);
+    pthread_mutex_unlock(&dir_lock);
+    return retval;
+}
+
+// return 0 at the end of the listing
+int sfs_readdir(const char *path, int offset, char *fname)
+{
+    pthread_mutex_lock(&dir_lock);
+    int dir = path_lookup(path);
+    if (dir == -1 || inode_table_cache[dir].mode != MODE_DIR)
+    {
+        pthread_mutex_unlock(&dir_lock);
+        return -1;
+    }
+
+    DIR_ENTRY dir_entry;
+    int next = dc_readdir(dir, offset, &dir_entry);
+    if (next != 0)
+        strcpy(fname, dir_entry.filename);
+    pthread_mutex_unlock(&dir_lock);
+    return next;
+}
+
+// return 0 at the end of the listing
+int sfs_readdirplus(const char *path, int offset, char *fname, int *inode_num,
+        int *size, int *is_dir)
+{
+    pthread_mutex_lock(&dir_lock);
+    int dir = path_lookup(path);
+    if (dir == -1 || inode_table_cache[dir].mode != MODE_DIR)
+    {
+        pthread_mutex_unlock(&dir_lock);
+        return -1;
+    }
+
+    DIR_ENTRY dir_entry;
+    int next = dc_readdir(dir, offset, &dir_entry);
+    if (next != 0)
+    {
+        INODE *inode_ptr = &(inode_table_cache[dir_entry.inode_num]);
+        strcpy(fname, dir_entry.filename);
+        *inode_num = dir_entry.inode_num;
+        *is_dir = (inode_ptr->mode == MODE_DIR);
+
+        // the file may be being written through a descriptor
+        *size = inode_size(dir_entry.inode_num);
+    }
+    pthread_mutex_unlock(&dir_lock);
+    return next;
+}
+
+// resolves the path and reads the mode and size of its inode, without
+// locking when every component is cached, which is what the metadata queries
+// below are mostly asked for. otherwise the directory lock keeps the inode
+// from being removed and reused while they are read
+static int lookup_for_stat(const char *path, int *mode, int *size)
+{
+    int inode_num = path_lookup_cached(path, mode, size);
+    if (inode_num == -1)
+    {
+        pthread_mutex_lock(&dir_lock);
+        inode_num = path_lookup(path);
+        if (inode_num != -1)
+        {
+            *mode = inode_table_cache[inode_num].mode;
+            *size = inode_size(inode_num);
+        }
+        pthread_mutex_unlock(&dir_lock);
+    }
+    return inode_num;
+}
+
+// return -1 if no file
+int sfs_isdir(const char *path)
+{
+    int mode, size;
+
+    if (lookup_for_stat(path, &mode, &size) == -1)
+        return -1;
+
+    return mode == MODE_DIR;
 }
 
 // return -1 if no file
 int sfs_getfilesize(const char* path)
 {
-    int inode_num = rdc_get_inode_num(path);
+    int mode, size;
 
-    if (inode_num == -1)
+    if (lookup_for_stat(path, &mode, &size) == -1)
         return -1;
 
-    return inode_table_cache[inode_num].size;
+    return size;
 }
 
 
-int sfs_fopen(char *name)
+// writes the buffered tail block of the descriptor to disk if it changed and
+// drops it. the inode is written as well if write_inode is set and it changed.
+// a failed write is recorded in the descriptor for the next flush to report.
+// must be called between jn_begin and jn_end
+static void flush_write_buffer(OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr,
+        int write_inode)
+{
+    if (fde_ptr->wbuf_index != -1 && fde_ptr->wbuf_dirty)
+    {
+        INODE *inode_ptr = &(inode_table_cache[fde_ptr->inode_num]);
+        int cur_block_addr = inode_index_to_address(*inode_ptr, fde_ptr->wbuf_index);
+
+        // a hole gets its block only now, so the data is written in the same
+        // transaction that logs the pointer to it and a crash can't leave the
+        // file pointing at a block that was never written
+        if (cur_block_addr == 0)
+        {
+            cur_block_addr = allocate_block_to_inode(inode_ptr, fde_ptr->wbuf_index);
+            if (cur_block_addr != -1)
+                write_inode = fde_ptr->inode_dirty = 1;
+        }
+
+        if (cur_block_addr == -1 || bc_write(cur_block_addr, fde_ptr->wbuf) < 0)
+            fde_ptr->write_error = 1;
+    }
+
+    fde_ptr->wbuf_index = -1;
+    fde_ptr->wbuf_dirty = 0;
+
+    if (write_inode && fde_ptr->inode_dirty)
+    {
+        inode_to_disk(fde_ptr->inode_num);
+        fde_ptr->inode_dirty = 0;
+    }
+}
+
+// makes the block at the given index of the inode the buffered one, flushing
+// the previous one. a hole is given a block when the buffer is flushed, but
+// the disk being full is checked now so it is usually reported by the write
+// rather than the flush
+// returns -1 if no block is free or the buffer can't be allocated
+static int load_write_buffer(OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr, int index)
 {
-    if (strlen(name) > MAX_FILENAME)
+    if (fde_ptr->wbuf_index == index)
+        return 0;
+
+    flush_write_buffer(fde_ptr, 0);
+
+    if (fde_ptr->wbuf == NULL)
+    {
+        fde_ptr->wbuf = (char*) malloc(BLOCK_SIZE);
+        if (fde_ptr->wbuf == NULL)
+            return -1;
+    }
+
+    INODE *inode_ptr = &(inode_table_cache[fde_ptr->inode_num]);
+    int cur_block_addr = inode_index_to_address(*inode_ptr, index);
+
+    if (cur_block_addr == 0)
+    {
+        if (!fm_is_available(1))
+            return -1;
+
+        memset(fde_ptr->wbuf, 0, BLOCK_SIZE);
+
+        // the block must be written even if nothing is copied into it
+        fde_ptr->wbuf_dirty = 1;
+    }
+    else if (cur_block_addr == -1)
     {
         return -1;
     }
+    else
+    {
+        bc_read(cur_block_addr, fde_ptr->wbuf);
+    }
+
+    fde_ptr->wbuf_index = index;
+    return 0;
+}
 
-    // check that file isn't already open
-    if (is_file_open(name))
+// takes the inode's lock shared for reading through the descriptor. a block
+// left in the descriptor's write buffer is written out first, under the
+// exclusive lock, so the read sees it
+static void lock_for_read(OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr)
+{
+    inode_rdlock(fde_ptr->inode_num);
+    while (fde_ptr->wbuf_index != -1)
+    {
+        inode_unlock(fde_ptr->inode_num);
+        jn_begin();
+        inode_wrlock(fde_ptr->inode_num);
+        flush_write_buffer(fde_ptr, 0);
+        inode_unlock(fde_ptr->inode_num);
+        jn_end();
+        inode_rdlock(fde_ptr->inode_num);
+    }
+}
+
+// called when an operation ran out of space. blocks freed by operations that
+// aren't committed yet are only reused after the commit, so one is forced if
+// there are any. returns 1 if the operation may be tried again
+static int release_held_blocks()
+{
+    int err = errno;
+    int released = fm_held_count() > 0 && jn_commit() == 0;
+    errno = err;
+    return released;
+}
+
+// sfs_fopen without the directory lock
+static int open_file(char *name)
+{
+    char file_name[MAX_FILENAME + 1];
+    int dir = path_parent(name, file_name);
+
+    if (dir == -1)
     {
         return -1;
     }
 
-    int inode_num = rdc_get_inode_num(name);
+    // a path ending at the root directory has no file name
+    if (file_name[0] == '\0')
+    {
+        errno = EISDIR;
+        return -1;
+    }
+
+    int inode_num = dc_lookup(dir, file_name);
+
+    // directories can't be opened, and a file only once at a time
+    if (inode_num >= 0 && inode_table_cache[inode_num].mode == MODE_DIR)
+    {
+        errno = EISDIR;
+        return -1;
+    }
+    if (inode_num >= 0 && is_inode_open(inode_num))
+    {
+        errno = EBUSY;
+        return -1;
+    }
 
     // create new file if it doesn't exist
     if (inode_num < 0)
     {
-        INODE *root_inode_ptr = &(inode_table_cache[ROOT_DIR_INODE_NUM]);
-
-        // check if need to allocate new block in dir table
-        if ((root_inode_ptr->size % BLOCK_SIZE) == 0)
-        {
-            // allocate a block to the root inode and make sure there was
-            // enough space to do so
-            if (allocate_block_to_inode(root_inode_ptr) == -1)
-            {
-                printf("insufficient space to create file\n");
-                return -1;
-            }
-        }
-
-        // allocate inode for file and write to disk
-        for (int i = 0; i < INODE_TABLE_LENGTH * (BLOCK_SIZE/sizeof(INODE)); i++)
-        {
-            if (!inode_table_cache[i].valid)
-            {
-                inode_num = i;
-                break;
-            }
-        }
+        // allocate inode for file, disk is updated later
+        inode_num = allocate_inode(MODE_FILE);
         if (inode_num < 0)
         {
             printf("insufficient inodes to create file\n");
+            errno = ENOSPC;
             return -1;
         }
-        inode_table_cache[inode_num].valid = 1;
-        inode_table_cache[inode_num].size = 0; // disk is updated later
 
-        // write dir entry to root directory cache
+        // write dir entry to the directory cache and the on-disk directory
         DIR_ENTRY dir_entry;
         dir_entry.inode_num = inode_num;
-        strcpy(dir_entry.filename, name);
-        rdc_insert(dir_entry);
-
-        // write dir entry to dir table on disk
-        rdc_to_disk();
+        strcpy(dir_entry.filename, file_name);
+        if (dc_insert(dir, dir_entry) == -1)
+        {
+            inode_table_cache[inode_num].valid = 0;
+            printf("insufficient space to create file\n");
+            errno = ENOSPC;
+            return -1;
+        }
 
-        // update size of root inode
-        root_inode_ptr->size += sizeof(DIR_ENTRY);
-        // update inode table in disk
-        write_blocks(1, INODE_TABLE_LENGTH, inode_table_cache);
+        // update inode table in disk, dc_insert may have grown the directory
+        inode_to_disk(dir);
+        inode_to_disk(inode_num);
     }
 
-    int fd = get_next_fd();
+    int fd = get_next_fd(inode_num);
     if (fd < 0)
     {
-        printf("error: maximum number of files already open\n");
+        printf("error: could not grow the open file descriptor table\n");
+        errno = ENOMEM;
         return -1;
     }
 
-    open_file_descriptor_table[fd].valid = 1;
-    open_file_descriptor_table[fd].rptr = 0;
-    open_file_descriptor_table[fd].wptr = inode_table_cache[inode_num].size;
-    open_file_descriptor_table[fd].inode_num = inode_num;
+    // nothing writes to the file before it is opened, its size is stable
+    get_fd_entry(fd)->rptr = 0;
+    get_fd_entry(fd)->wptr = inode_table_cache[inode_num].size;
 
+    return fd;
+}
 
+int sfs_fopen(char *name)
+{
+    jn_begin();
+    pthread_mutex_lock(&dir_lock);
+    errno = 0;
+    int fd = open_file(name);
+    pthread_mutex_unlock(&dir_lock);
+    jn_end();
+
+    if (fd == -1 && errno == ENOSPC && release_held_blocks())
+        return sfs_fopen(name);
     return fd;
 }
 
@@ -195,210 +522,812 @@ int sfs_fclose(int fileID)
 {
     int retval = 0;
 
-    if (!open_file_descriptor_table[fileID].valid)
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
     {
         retval = 1;
     }
     else
     {
-        open_file_descriptor_table[fileID].valid = 0;
+        jn_begin();
+        inode_wrlock(fde_ptr->inode_num);
+        flush_write_buffer(fde_ptr, 1);
+        if (fde_ptr->write_error)
+            retval = -1;
+        inode_unlock(fde_ptr->inode_num);
+        jn_end();
+        release_fd(fileID);
     }
     return retval;
 }
 
 int sfs_frseek(int fileID, int loc)
 {
-    if (!open_file_descriptor_table[fileID].valid)
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
     {
         return -1;
     }
 
-    INODE inode = inode_table_cache[open_file_descriptor_table[fileID].inode_num];
-
-    if (loc > inode.size)
+    if (loc > inode_size(fde_ptr->inode_num))
     {
         printf("attempt to seek out of bounds\n");
         return -1;
     }
 
-    open_file_descriptor_table[fileID].rptr = loc;
+    fde_ptr->rptr = loc;
     return 0;
 }
 
 int sfs_fwseek(int fileID, int loc)
 {
-    if (!open_file_descriptor_table[fileID].valid)
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
     {
         printf("file id %d does not refer to an open file\n", fileID);
         return -1;
     }
 
-    INODE inode = inode_table_cache[open_file_descriptor_table[fileID].inode_num];
-
-    if (loc > inode.size)
+    // seeking past the end of the file is allowed, the gap becomes a hole
+    // once something is written
+    if (loc < 0)
     {
         printf("attempt to seek out of bounds\n");
         return -1;
     }
 
-    open_file_descriptor_table[fileID].wptr = loc;
+    jn_begin();
+    inode_wrlock(fde_ptr->inode_num);
+    flush_write_buffer(fde_ptr, 1);
+    fde_ptr->wptr = loc;
+    inode_unlock(fde_ptr->inode_num);
+    jn_end();
     return 0;
 }
 
-// treats inode like 2d array
-// ith byte in inode = inode[wptr / BLOCK_SIZE][wptr % BLOCK_SIZE]
-// returns the amount of bytes written
-int sfs_fwrite(int fileID, const char *buf, int length)
+int sfs_fflush(int fileID)
 {
-    int bytes_written = 0;
-    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = &(open_file_descriptor_table[fileID]);
-    INODE *inode_ptr = &(inode_table_cache[fde_ptr->inode_num]); 
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
+    {
+        return -1;
+    }
+
+    jn_begin();
+    inode_wrlock(fde_ptr->inode_num);
+    flush_write_buffer(fde_ptr, 1);
+    int write_error = fde_ptr->write_error;
+    fde_ptr->write_error = 0;
+    inode_unlock(fde_ptr->inode_num);
+    jn_end();
+    return write_error ? -1 : 0;
+}
 
-    if (!fde_ptr->valid)
+int sfs_fsync(int fileID)
+{
+    if (sfs_fflush(fileID) == -1)
     {
         return -1;
     }
 
-    int cur_inode_i = fde_ptr->wptr / BLOCK_SIZE;
-    int cur_block_addr;
+    // the commit's barriers make the file's data durable along with the
+    // metadata
+    return jn_commit();
+}
+
+int sfs_sync()
+{
+    return jn_commit();
+}
+
+// copies length bytes out of the iovec array into dst, starting at the
+// position given by seg and seg_off, and advances the position
+static void iov_gather(char *dst, const struct iovec *iov, int *seg,
+        size_t *seg_off, int length)
+{
+    while (length > 0)
+    {
+        size_t n = iov[*seg].iov_len - *seg_off;
+        if (n > length)
+            n = length;
+
+        memcpy(dst, (char*) iov[*seg].iov_base + *seg_off, n);
+        dst += n;
+        length -= n;
+        *seg_off += n;
+
+        if (*seg_off == iov[*seg].iov_len)
+        {
+            (*seg)++;
+            *seg_off = 0;
+        }
+    }
+}
+
+// counterpart of iov_gather, copies length bytes from src into the iovec array
+static void iov_scatter(const char *src, const struct iovec *iov, int *seg,
+        size_t *seg_off, int length)
+{
+    while (length > 0)
+    {
+        size_t n = iov[*seg].iov_len - *seg_off;
+        if (n > length)
+            n = length;
+
+        memcpy((char*) iov[*seg].iov_base + *seg_off, src, n);
+        src += n;
+        length -= n;
+        *seg_off += n;
+
+        if (*seg_off == iov[*seg].iov_len)
+        {
+            (*seg)++;
+            *seg_off = 0;
+        }
+    }
+}
+
+// backs reads of holes
+static const char zero_block[BLOCK_SIZE];
+
+static int iov_length(const struct iovec *iov, int iovcnt)
+{
+    int length = 0;
+    for (int i = 0; i < iovcnt; i++)
+        length += iov[i].iov_len;
+    return length;
+}
+
+// treats inode like 2d array
+// ith byte in inode = inode[off / BLOCK_SIZE][off % BLOCK_SIZE]
+// data is copied a block at a time and the file size is updated in the cache
+// only, the caller is responsible for writing the inode to disk
+// returns the amount of bytes written
+static int inode_write(INODE *inode_ptr, int off, const struct iovec *iov,
+        int iovcnt)
+{
+    int length = iov_length(iov, iovcnt);
+    int bytes_written = 0;
+    int seg = 0;
+    size_t seg_off = 0;
+
+    // skip empty segments so a whole block can be taken from the current one
+    while (seg < iovcnt && iov[seg].iov_len == 0)
+        seg++;
+
     char *block_buf = (char*) malloc(BLOCK_SIZE);
 
-    for (int i = 0; i < length; i++)
+    while (bytes_written < length)
     {
-        // need to allocate new block
-        if (fde_ptr->wptr % BLOCK_SIZE == 0 && fde_ptr->wptr == inode_ptr->size)
+        int cur_inode_i = off / BLOCK_SIZE;
+        int block_offset = off % BLOCK_SIZE;
+        int chunk = BLOCK_SIZE - block_offset;
+        if (chunk > length - bytes_written)
+            chunk = length - bytes_written;
+
+        const char *src = block_buf;
+        int cur_block_addr = inode_index_to_address(*inode_ptr, cur_inode_i);
+
+        // allocate blocks for holes and past the end of the file, blocks
+        // skipped over by a seek past the end are left as holes
+        if (cur_block_addr == 0)
         {
             // stop writing if there's no space left on disk
-            if (allocate_block_to_inode(inode_ptr) == -1)
+            cur_block_addr = allocate_block_to_inode(inode_ptr, cur_inode_i);
+            if (cur_block_addr == -1)
                 break;
-        }
 
-        // need to get next block
-        if (fde_ptr->wptr % BLOCK_SIZE == 0 || i == 0)
+            // a fresh block has no contents worth reading, pad it with zeros
+            if (chunk < BLOCK_SIZE)
+                memset(block_buf, 0, BLOCK_SIZE);
+        }
+        else if (cur_block_addr == -1)
+        {
+            // past what an inode can refer to
+            break;
+        }
+        else
         {
-            // get address here to ensure it has been allocated in inode first
-            cur_block_addr = inode_index_to_address(*inode_ptr, cur_inode_i);
+            // only partially overwritten blocks need to be read first
+            if (chunk < BLOCK_SIZE)
+                bc_read(cur_block_addr, block_buf);
+        }
 
-            // write prev block to disk
-            if (i != 0)
+        // a whole block held by one segment is written without copying it
+        if (chunk == BLOCK_SIZE && iov[seg].iov_len - seg_off >= BLOCK_SIZE)
+        {
+            src = (char*) iov[seg].iov_base + seg_off;
+            seg_off += BLOCK_SIZE;
+            if (seg_off == iov[seg].iov_len)
             {
-                write_blocks(cur_block_addr, 1, block_buf);
-                cur_inode_i++;
-                cur_block_addr = inode_index_to_address(*inode_ptr, cur_inode_i);
+                seg++;
+                seg_off = 0;
             }
-            // get next block
-            read_blocks(cur_block_addr, 1, block_buf);
         }
-
-        block_buf[fde_ptr->wptr % BLOCK_SIZE] = buf[i];
-        fde_ptr->wptr++;
-        bytes_written++;
-        
-        if ((fde_ptr->wptr - 1) == inode_ptr->size)
+        else
         {
-            inode_ptr->size++;
+            iov_gather(block_buf + block_offset, iov, &seg, &seg_off, chunk);
         }
+
+        // a block that can't be written ends the write like a full disk
+        if (bc_write(cur_block_addr, src) < 0)
+            break;
+        off += chunk;
+        bytes_written += chunk;
+
+        while (seg < iovcnt && seg_off == 0 && iov[seg].iov_len == 0)
+            seg++;
     }
 
-    write_blocks(cur_block_addr, 1, block_buf);
     free(block_buf);
 
-    // update cache to disk
-    write_blocks(1, INODE_TABLE_LENGTH, inode_table_cache);
+    if (bytes_written > 0 && off > inode_ptr->size)
+    {
+        inode_set_size(inode_ptr - inode_table_cache, off);
+    }
+
     return bytes_written;
 }
 
-int sfs_fread(int fileID, char *buf, int length)
+// blocks read ahead of a read reaching the end of a block
+#define READAHEAD_BLOCKS 4
+
+// starts reading the blocks of the file covered by the read into the block
+// cache, so they are read in parallel and merged where they are contiguous
+// rather than one at a time as the read gets to them. a read ending on a
+// block boundary is likely followed by the next blocks, they are prefetched
+// too. the caller has clamped length to the size of the file
+static void prefetch(INODE *inode_ptr, int off, int length)
+{
+    if (length <= 0)
+        return;
+
+    int first = off / BLOCK_SIZE;
+    int last = (off + length - 1) / BLOCK_SIZE;
+
+    // a read within one block is served as fast by reading it directly
+    if (first == last && (off + length) % BLOCK_SIZE != 0)
+        return;
+
+    if ((off + length) % BLOCK_SIZE == 0)
+        last += READAHEAD_BLOCKS;
+    if (last > (inode_ptr->size - 1) / BLOCK_SIZE)
+        last = (inode_ptr->size - 1) / BLOCK_SIZE;
+
+    for (int i = first; i <= last; i++)
+    {
+        int address = inode_index_to_address(*inode_ptr, i);
+        if (address != 0)
+            bc_prefetch(address);
+    }
+}
+
+// returns the amount of bytes read, which is less than requested when the
+// end of the file is reached
+static int inode_read(INODE *inode_ptr, int off, const struct iovec *iov,
+        int iovcnt)
 {
+    int length = iov_length(iov, iovcnt);
     int bytes_read = 0;
-    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = &(open_file_descriptor_table[fileID]);
+    int seg = 0;
+    size_t seg_off = 0;
+
+    // don't try and read past the size of the file
+    if (length > inode_ptr->size - off)
+        length = inode_ptr->size - off;
+
+    prefetch(inode_ptr, off, length);
+
+    while (bytes_read < length)
+    {
+        int cur_inode_i = off / BLOCK_SIZE;
+        int block_offset = off % BLOCK_SIZE;
+        int chunk = BLOCK_SIZE - block_offset;
+        if (chunk > length - bytes_read)
+            chunk = length - bytes_read;
+
+        int cur_block_addr = inode_index_to_address(*inode_ptr, cur_inode_i);
+
+        // holes read as zeros without touching the disk
+        if (cur_block_addr == 0)
+        {
+            iov_scatter(zero_block, iov, &seg, &seg_off, chunk);
+            off += chunk;
+            bytes_read += chunk;
+            continue;
+        }
+
+        char *block = bc_get(cur_block_addr);
+
+        if (block != NULL)
+        {
+            iov_scatter(block + block_offset, iov, &seg, &seg_off, chunk);
+            bc_release(block);
+        }
+        else // every cache buffer is pinned, read around the cache
+        {
+            char block_buf[BLOCK_SIZE];
+            if (io_read(cur_block_addr, 1, block_buf) < 0)
+                break;
+            iov_scatter(block_buf + block_offset, iov, &seg, &seg_off, chunk);
+        }
+
+        off += chunk;
+        bytes_read += chunk;
+    }
+
+    return bytes_read;
+}
+
+int sfs_fwrite(int fileID, const char *buf, int length)
+{
+    struct iovec iov = { (void*) buf, length < 0 ? 0 : length };
+    return sfs_fwritev(fileID, &iov, 1);
+}
+
+int sfs_fread(int fileID, char *buf, int length)
+{
+    struct iovec iov = { buf, length < 0 ? 0 : length };
+    return sfs_freadv(fileID, &iov, 1);
+}
+
+int sfs_fwritev(int fileID, const struct iovec *iov, int iovcnt)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
+    {
+        return -1;
+    }
+
+    jn_begin();
+    inode_wrlock(fde_ptr->inode_num);
+
     INODE *inode_ptr = &(inode_table_cache[fde_ptr->inode_num]);
+    int length = iov_length(iov, iovcnt);
+    int block_offset = fde_ptr->wptr % BLOCK_SIZE;
+
+    // a small write within one block goes to the descriptor's buffer, so a
+    // run of them costs one block write. the buffer is written out when the
+    // block fills or another one is written to, the inode on close, seek and
+    // sfs_fsync
+    if (length > 0 && length < BLOCK_SIZE && block_offset + length <= BLOCK_SIZE
+            && load_write_buffer(fde_ptr, fde_ptr->wptr / BLOCK_SIZE) == 0)
+    {
+        int seg = 0;
+        size_t seg_off = 0;
+        iov_gather(fde_ptr->wbuf + block_offset, iov, &seg, &seg_off, length);
+        fde_ptr->wbuf_dirty = 1;
+        fde_ptr->wptr += length;
+
+        if (fde_ptr->wptr > inode_ptr->size)
+        {
+            inode_set_size(fde_ptr->inode_num, fde_ptr->wptr);
+            fde_ptr->inode_dirty = 1;
+        }
+
+        if (block_offset + length == BLOCK_SIZE)
+            flush_write_buffer(fde_ptr, 0);
+
+        inode_unlock(fde_ptr->inode_num);
+        jn_end();
+        return length;
+    }
+
+    flush_write_buffer(fde_ptr, 0);
+
+    int bytes_written = inode_write(inode_ptr, fde_ptr->wptr, iov, iovcnt);
+    fde_ptr->wptr += bytes_written;
+
+    // update cache to disk
+    inode_to_disk(fde_ptr->inode_num);
+    fde_ptr->inode_dirty = 0;
+    inode_unlock(fde_ptr->inode_num);
+    jn_end();
+
+    // a short write is returned as is. only a write that wrote nothing forces
+    // a commit, when it is tried again
+    if (bytes_written == 0 && length > 0 && release_held_blocks())
+        return sfs_fwritev(fileID, iov, iovcnt);
+    return bytes_written;
+}
 
-    if (!fde_ptr->valid)
+int sfs_freadv(int fileID, const struct iovec *iov, int iovcnt)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
     {
         return -1;
     }
 
-    int cur_inode_i = fde_ptr->rptr / BLOCK_SIZE;
-    int cur_inode_addr = inode_index_to_address(*inode_ptr, cur_inode_i);
-    char *block_buf = (char*) malloc(BLOCK_SIZE);
+    lock_for_read(fde_ptr);
+
+    int bytes_read = inode_read(&(inode_table_cache[fde_ptr->inode_num]),
+            fde_ptr->rptr, iov, iovcnt);
+    fde_ptr->rptr += bytes_read;
+
+    inode_unlock(fde_ptr->inode_num);
+    return bytes_read;
+}
 
-    for (int i = 0; i < length; i++)
+int sfs_pwrite(int fileID, const char *buf, int length, int off)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+    struct iovec iov = { (void*) buf, length < 0 ? 0 : length };
+
+    if (fde_ptr == NULL || off < 0)
+    {
+        return -1;
+    }
+
+    jn_begin();
+    inode_wrlock(fde_ptr->inode_num);
+    flush_write_buffer(fde_ptr, 0);
+
+    int bytes_written = inode_write(&(inode_table_cache[fde_ptr->inode_num]),
+            off, &iov, 1);
+
+    // update cache to disk
+    inode_to_disk(fde_ptr->inode_num);
+    fde_ptr->inode_dirty = 0;
+    inode_unlock(fde_ptr->inode_num);
+    jn_end();
+
+    if (bytes_written == 0 && iov.iov_len > 0 && release_held_blocks())
+        return sfs_pwrite(fileID, buf, length, off);
+    return bytes_written;
+}
+
+int sfs_pread(int fileID, char *buf, int length, int off)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+    struct iovec iov = { buf, length < 0 ? 0 : length };
+
+    if (fde_ptr == NULL || off < 0)
+    {
+        return -1;
+    }
+
+    lock_for_read(fde_ptr);
+    int bytes_read = inode_read(&(inode_table_cache[fde_ptr->inode_num]),
+            off, &iov, 1);
+    inode_unlock(fde_ptr->inode_num);
+    return bytes_read;
+}
+
+int sfs_ftruncate(int fileID, int size)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    if (size < 0 || size > (12 + 256) * BLOCK_SIZE)
+    {
+        errno = (size < 0) ? EINVAL : EFBIG;
+        return -1;
+    }
+
+    jn_begin();
+    inode_wrlock(fde_ptr->inode_num);
+    flush_write_buffer(fde_ptr, 0);
+
+    INODE *inode_ptr = &(inode_table_cache[fde_ptr->inode_num]);
+
+    if (size < inode_ptr->size)
+    {
+        // free every block that lies entirely past the new end
+        deallocate_inode_blocks(inode_ptr, (size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+        // zero the rest of the new last block so growing the file again
+        // doesn't bring the old data back
+        int cur_block_addr = inode_index_to_address(*inode_ptr, size / BLOCK_SIZE);
+        if (size % BLOCK_SIZE != 0 && cur_block_addr > 0)
+        {
+            char block_buf[BLOCK_SIZE];
+            bc_read(cur_block_addr, block_buf);
+            memset(block_buf + size % BLOCK_SIZE, 0, BLOCK_SIZE - size % BLOCK_SIZE);
+            bc_write(cur_block_addr, block_buf);
+        }
+    }
+
+    // growing only moves the end of the file, the new part is a hole
+    inode_set_size(fde_ptr->inode_num, size);
+    inode_to_disk(fde_ptr->inode_num);
+    fde_ptr->inode_dirty = 0;
+    inode_unlock(fde_ptr->inode_num);
+    jn_end();
+    return 0;
+}
+
+int sfs_fseekdata(int fileID, int loc)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL || loc < 0)
+    {
+        return -1;
+    }
+
+    // a buffered hole is given its block when it is written out
+    lock_for_read(fde_ptr);
+    INODE inode = inode_table_cache[fde_ptr->inode_num];
+
+    // -1 if there's no data at or after loc
+    int retval = -1;
+
+    for (int i = loc / BLOCK_SIZE; i * BLOCK_SIZE < inode.size && loc < inode.size; i++)
     {
-        // don't try and read past the size of the file
-        if (fde_ptr->rptr == inode_ptr->size)
+        if (inode_index_to_address(inode, i) > 0)
+        {
+            retval = (i * BLOCK_SIZE > loc) ? i * BLOCK_SIZE : loc;
             break;
+        }
+    }
+
+    inode_unlock(fde_ptr->inode_num);
+    return retval;
+}
+
+int sfs_fseekhole(int fileID, int loc)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
+
+    if (fde_ptr == NULL || loc < 0)
+    {
+        return -1;
+    }
 
-        // need to get next block
-        if (fde_ptr->rptr % BLOCK_SIZE == 0 || i == 0)
+    lock_for_read(fde_ptr);
+    INODE inode = inode_table_cache[fde_ptr->inode_num];
+    int retval = -1;
+
+    if (loc < inode.size)
+    {
+        // there is always an implicit hole at the end of the file
+        retval = inode.size;
+
+        for (int i = loc / BLOCK_SIZE; i * BLOCK_SIZE < inode.size; i++)
         {
-            if (i != 0)
+            if (inode_index_to_address(inode, i) == 0)
             {
-                cur_inode_i++;
-                cur_inode_addr = inode_index_to_address(*inode_ptr, cur_inode_i);
+                retval = (i * BLOCK_SIZE > loc) ? i * BLOCK_SIZE : loc;
+                break;
             }
-            // get next block
-            read_blocks(cur_inode_addr, 1, block_buf);
         }
+    }
+
+    inode_unlock(fde_ptr->inode_num);
+    return retval;
+}
+
+int sfs_fread_pinned(int fileID, int off, int length, struct iovec *iov_out,
+        char *pinned_out, int iovcnt)
+{
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY* fde_ptr = get_fd_entry(fileID);
 
-        buf[i] = block_buf[fde_ptr->rptr % BLOCK_SIZE];
-        fde_ptr->rptr++;
-        bytes_read++;
+    if (fde_ptr == NULL || off < 0)
+    {
+        return -1;
     }
 
-    free(block_buf);
-    return bytes_read;
+    lock_for_read(fde_ptr);
+
+    INODE *inode_ptr = &(inode_table_cache[fde_ptr->inode_num]);
+
+    // don't try and read past the size of the file
+    if (length > inode_ptr->size - off)
+        length = inode_ptr->size - off;
+
+    prefetch(inode_ptr, off, length);
+
+    int n = 0;
+    while (length > 0 && n < iovcnt)
+    {
+        int block_offset = off % BLOCK_SIZE;
+        int chunk = BLOCK_SIZE - block_offset;
+        if (chunk > length)
+            chunk = length;
+
+        int cur_block_addr = inode_index_to_address(*inode_ptr, off / BLOCK_SIZE);
+        char *block = (char*) zero_block;
+
+        if (cur_block_addr != 0)
+        {
+            block = bc_get(cur_block_addr);
+
+            // stop early rather than fail when the cache runs out of buffers
+            if (block == NULL)
+                break;
+        }
+
+        iov_out[n].iov_base = block + block_offset;
+        iov_out[n].iov_len = chunk;
+        pinned_out[n] = cur_block_addr != 0;
+        n++;
+
+        off += chunk;
+        length -= chunk;
+    }
+
+    inode_unlock(fde_ptr->inode_num);
+    return n;
 }
 
-// return zero on success
-int sfs_remove(char *file)
+void sfs_fread_release(struct iovec *iov, const char *pinned, int iovcnt)
+{
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (pinned[i])
+            bc_release(iov[i].iov_base);
+    }
+}
+
+// sfs_remove without the directory lock
+static int remove_file(char *file)
 {
-    // don't remove if file is open
-    if (is_file_open(file))
+    char file_name[MAX_FILENAME + 1];
+    int dir = path_parent(file, file_name);
+    if (dir == -1)
     {
-        return 1;
+        return -1;
     }
 
-    int inode_num = rdc_get_inode_num(file);
+    // directories are removed with sfs_rmdir, and open files not at all
+    int inode_num = (file_name[0] == '\0') ? dir : dc_lookup(dir, file_name);
     if (inode_num == -1)
     {
-        return 1;
+        errno = ENOENT;
+        return -1;
+    }
+    if (inode_table_cache[inode_num].mode == MODE_DIR)
+    {
+        errno = EISDIR;
+        return -1;
+    }
+    if (is_inode_open(inode_num))
+    {
+        errno = EBUSY;
+        return -1;
     }
 
     INODE *inode_ptr = &(inode_table_cache[inode_num]);
-    int freemap[BLOCK_SIZE * 8 / 32];
-    read_blocks(1 + INODE_TABLE_LENGTH, 1, freemap);
 
-    int blocks_to_free = inode_ptr->size / BLOCK_SIZE;
-    if (inode_ptr->size % BLOCK_SIZE != 0) blocks_to_free++;
+    // set data blocks pointed by inode to free in freemap
+    deallocate_inode_blocks(inode_ptr, 0);
 
-    int addr_to_free;
-    int b; // bit to free
+    // set inode entry to invalid
+    inode_ptr->valid = 0;
 
-    // set data blocks pointed by inode to free in freemap
-    for (int i = 0; i < blocks_to_free; i++)
+    // remove dir entry from cache and update disk
+    dc_remove(dir, file_name);
+    inode_to_disk(dir);
+    inode_to_disk(inode_num);
+
+    return 0; 
+}
+
+int sfs_remove(char *file)
+{
+    jn_begin();
+    pthread_mutex_lock(&dir_lock);
+    int retval = remove_file(file);
+    pthread_mutex_unlock(&dir_lock);
+    jn_end();
+    return retval;
+}
+
+// sfs_mkdir without the directory lock
+static int make_dir(char *path)
+{
+    char dir_name[MAX_FILENAME + 1];
+    int parent = path_parent(path, dir_name);
+    if (parent == -1)
+    {
+        return -1;
+    }
+    if (dir_name[0] == '\0' || dc_lookup(parent, dir_name) != -1)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+
+    int inode_num = allocate_inode(MODE_DIR);
+    if (inode_num < 0)
     {
-        addr_to_free = inode_index_to_address(*inode_ptr, i);
-        b = addr_to_free - 1 - INODE_TABLE_LENGTH; // bit to free
-        freemap[b/32] = freemap[b/32] & ~(1 << b%32); // clear bit
+        errno = ENOSPC;
+        return -1;
     }
 
-    // set indirect pointer to free if necessary
-    if (blocks_to_free >= 12)
+    DIR_ENTRY dir_entry;
+    dir_entry.inode_num = inode_num;
+    strcpy(dir_entry.filename, dir_name);
+    if (dc_insert(parent, dir_entry) == -1)
     {
-        addr_to_free = inode_ptr->ind_ptr;
-        b = addr_to_free - 1 - INODE_TABLE_LENGTH;
-        freemap[b/32] = freemap[b/32] & ~(1 << b%32); // clear bit
+        inode_table_cache[inode_num].valid = 0;
+        errno = ENOSPC;
+        return -1;
     }
 
-    // set inode entry to invalid
+    inode_to_disk(parent);
+    inode_to_disk(inode_num);
+    return 0;
+}
+
+int sfs_mkdir(char *path)
+{
+    jn_begin();
+    pthread_mutex_lock(&dir_lock);
+    errno = 0;
+    int retval = make_dir(path);
+    pthread_mutex_unlock(&dir_lock);
+    jn_end();
+
+    if (retval == -1 && errno == ENOSPC && release_held_blocks())
+        return sfs_mkdir(path);
+    return retval;
+}
+
+// sfs_rmdir without the directory lock
+static int remove_dir(char *path)
+{
+    char dir_name[MAX_FILENAME + 1];
+    int parent = path_parent(path, dir_name);
+    if (parent == -1)
+    {
+        return -1;
+    }
+
+    // the root directory is always in use
+    if (dir_name[0] == '\0')
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    int inode_num = dc_lookup(parent, dir_name);
+    if (inode_num == -1)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    if (inode_table_cache[inode_num].mode != MODE_DIR)
+    {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    // only empty directories are removed
+    DIR_ENTRY dir_entry;
+    if (dc_readdir(inode_num, 0, &dir_entry) != 0)
+    {
+        errno = ENOTEMPTY;
+        return -1;
+    }
+
+    INODE *inode_ptr = &(inode_table_cache[inode_num]);
+    deallocate_inode_blocks(inode_ptr, 0);
     inode_ptr->valid = 0;
 
-    // remove dir entry from cache and update disk
-    rdc_remove(file);
-    rdc_to_disk();
-    inode_table_cache[ROOT_DIR_INODE_NUM].size -= sizeof(DIR_ENTRY);
-    write_blocks(1, INODE_TABLE_LENGTH, inode_table_cache);
+    dc_remove(parent, dir_name);
+    inode_to_disk(parent);
+    inode_to_disk(inode_num);
+    return 0;
+}
 
-    return 0; 
+int sfs_rmdir(char *path)
+{
+    jn_begin();
+    pthread_mutex_lock(&dir_lock);
+    int retval = remove_dir(path);
+    pthread_mutex_unlock(&dir_lock);
+    jn_end();
+    return retval;
 }
\ No newline at end of file
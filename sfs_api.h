@@ -1,3 +1,4 @@
+#include <sys/uio.h>
 
 /**
  * creates the file system
@@ -7,12 +8,46 @@
 void mksfs(int fresh); // creates the file system
 
 /**
- * stores the next filename of the listing in fname
+ * writes every change to its home location on the disk and marks it as
+ * unmounted cleanly, so the next mount reads only the blocks it needs.
+ * the write buffers of files still open are written out first, the disk is
+ * not marked clean if that fails. does nothing if no disk is mounted, mksfs
+ * calls it for the previous disk
+ */
+void sfs_unmount();
+
+/**
+ * stores the next filename of the listing of the root directory in fname
  * 
  * returns 1 if there was a next filename, otherwise 0
  */
 int sfs_getnextfilename(char *fname); 
 
+/**
+ * stores the name of the first file at or after the given offset of the
+ * listing of the directory at path in fname. a listing starts at offset 0 and
+ * resumes from the offset returned for the previous file. offsets stay valid
+ * while other files are created and removed, so several listings can be in
+ * progress at once
+ * 
+ * returns -1 if path is not a directory
+ * returns the offset of the next file, or 0 if there are no more files
+ */
+int sfs_readdir(const char *path, int offset, char *fname);
+
+/**
+ * same as sfs_readdir, also storing the file's inode number, size and whether
+ * it is a directory so the caller doesn't need to look each file up again
+ */
+int sfs_readdirplus(const char *path, int offset, char *fname, int *inode_num,
+        int *size, int *is_dir);
+
+/**
+ * returns 1 if the path is a directory, 0 if it is a file
+ * returns -1 if it does not exist
+ */
+int sfs_isdir(const char *path);
+
 /**
  * returns the size of the given file in bytes
  * returns -1 if the file does not exist
@@ -23,15 +58,20 @@ int sfs_getfilesize(const char* path); // get the size of the given file
  * opens the given file for reading and writing. creates the file if it does
  * not exist already
  * 
- * returns the file ID on success, returns -1 otherwise
+ * returns the file ID on success, returns -1 otherwise with errno set to
+ * ENOENT or ENOTDIR if the parent directory doesn't exist, ENAMETOOLONG,
+ * EISDIR if the path is a directory, EBUSY if the file is open already or
+ * ENOSPC if no inode or block is left to create it
  */ 
 int sfs_fopen(char *name); 
 
 /**
- * closes the file, i.e. removes it from the open file descriptor table
+ * closes the file, i.e. removes it from the open file descriptor table.
+ * data still held in the descriptor's write buffer is written first
  * 
  * return 0 if the file was succesfully closed. 1 if the file was not open
- * in the first place
+ * in the first place. -1 if data held in the write buffer could not be
+ * written, the file is closed all the same
  */
 int sfs_fclose(int fileID);
 
@@ -44,13 +84,75 @@ int sfs_fclose(int fileID);
 int sfs_frseek(int fileID, int loc);
 
 /**
- * moves the open file's write pointer to the given location from the beginning
+ * moves the open file's write pointer to the given location from the beginning.
+ * the location may be past the end of the file, in which case the blocks
+ * skipped over are left unallocated (a hole) and read back as zeros
  * 
- * returns - if the seek was succesful. -1 if the file doesn't exist or the request
- * is larger than the file's size
+ * returns 0 if the seek was succesful. -1 if the file doesn't exist or the
+ * location is negative
  */
 int sfs_fwseek(int fileID, int loc);
 
+/**
+ * writes the data held in the descriptor's write buffer and the file's inode
+ * to disk. small writes are merged in a buffer for the block they fall in,
+ * which is otherwise only written when the block fills, on seek or on close.
+ * nothing is made durable, a crash may still lose the changes
+ * 
+ * returns 0 on success. -1 if the file id does not refer to an open file or
+ * a buffered block could not be written since the last flush
+ */
+int sfs_fflush(int fileID);
+
+/**
+ * like sfs_fflush, then makes the file and every other change made before
+ * the call durable, so they survive a crash once it returns
+ * 
+ * returns 0 on success. -1 if the file id does not refer to an open file or
+ * the changes could not be written to disk
+ */
+int sfs_fsync(int fileID);
+
+/**
+ * makes every change made before the call durable. data still held in the
+ * write buffers of descriptors isn't written, sfs_fflush or sfs_fsync does
+ * 
+ * returns 0 on success, -1 if the changes could not be written to disk
+ */
+int sfs_sync();
+
+/**
+ * sets the size of the file in place. shrinking frees the blocks past the new
+ * end, growing leaves the new part of the file as a hole. the file keeps its
+ * inode and the descriptors read and write pointers are not moved
+ * 
+ * returns 0 on success. returns -1 and sets errno to EBADF if the file id
+ * does not refer to an open file, EINVAL if the size is negative or EFBIG if
+ * it is larger than a file can be
+ */
+int sfs_ftruncate(int fileID, int size);
+
+/**
+ * finds the start of the next region of the file holding data, like lseek
+ * with SEEK_DATA. data is tracked per block, so a partially written block
+ * counts as data
+ * 
+ * returns the first offset at or after loc that is not in a hole. returns -1
+ * if the file id does not refer to an open file or there is no data at or
+ * after loc
+ */
+int sfs_fseekdata(int fileID, int loc);
+
+/**
+ * finds the start of the next hole in the file, like lseek with SEEK_HOLE.
+ * the end of the file counts as a hole
+ * 
+ * returns the first offset at or after loc that is in a hole. returns -1 if
+ * the file id does not refer to an open file or loc is past the end of the
+ * file
+ */
+int sfs_fseekhole(int fileID, int loc);
+
 /**
  * writes characters to the disk starting from the file descriptors write
  * pointer
@@ -77,10 +179,98 @@ int sfs_fwrite(int fileID, const char *buf, int length);
  */
 int sfs_fread(int fileID, char *buf, int length);
 
+/**
+ * vectored version of sfs_fwrite. the data described by the iovec array is
+ * written as a single operation starting from the file descriptors write
+ * pointer, so the file's inode is only updated once
+ * 
+ * returns the number of bytes written. returns -1 if the file id does not
+ * refer to an open file
+ */
+int sfs_fwritev(int fileID, const struct iovec *iov, int iovcnt);
+
+/**
+ * vectored version of sfs_fread. fills the buffers of the iovec array in order
+ * starting from the file descriptors read pointer
+ * 
+ * returns the number of bytes read. returns -1 if the file id does not
+ * refer to an open file
+ */
+int sfs_freadv(int fileID, const struct iovec *iov, int iovcnt);
+
+/**
+ * writes length bytes from buf at the given offset in the file. the file
+ * descriptors read and write pointers are neither used nor moved. writing
+ * past the end of the file leaves a hole between the old end and offset
+ * 
+ * returns the number of bytes written. returns -1 if the file id does not
+ * refer to an open file or the offset is negative
+ */
+int sfs_pwrite(int fileID, const char *buf, int length, int off);
+
+/**
+ * reads up to length bytes into buf from the given offset in the file. the
+ * file descriptors read and write pointers are neither used nor moved
+ * 
+ * returns the number of bytes read, 0 at or past the end of the file.
+ * returns -1 if the file id does not refer to an open file or the offset is
+ * negative
+ */
+int sfs_pread(int fileID, char *buf, int length, int off);
+
+/**
+ * reads without copying. instead of filling a caller supplied buffer, the
+ * iovecs are set to point directly at the cached blocks holding the data, one
+ * iovec per block. the blocks stay pinned in the cache until they are handed
+ * back with sfs_fread_release, so the iovecs must be released promptly. the
+ * file's read pointer is not used or moved
+ * 
+ * fileID - index in the open file desriptor table for the open file
+ * off - byte offset in the file to start reading from
+ * length - number of bytes to read
+ * iov_out - array receiving the pinned buffers
+ * pinned_out - array receiving, for each iovec, 1 if its buffer is pinned and
+ * 0 if it isn't (holes read as a shared block of zeros)
+ * iovcnt - number of entries in iov_out and pinned_out
+ * 
+ * returns the number of iovecs filled, which may cover less than length
+ * bytes if iov_out or the cache runs out of room. returns -1 if the file id
+ * does not refer to an open file
+ */
+int sfs_fread_pinned(int fileID, int off, int length, struct iovec *iov_out,
+        char *pinned_out, int iovcnt);
+
+/**
+ * unpins the buffers returned by sfs_fread_pinned, given the flags it filled
+ * in pinned
+ */
+void sfs_fread_release(struct iovec *iov, const char *pinned, int iovcnt);
+
 /**
  * removes a file from the file system and deallocates its data blocks
  * 
- * returns -1 if the file does not exist
+ * returns -1 and sets errno to ENOENT if the file does not exist, EISDIR if
+ * it is a directory or EBUSY if it is open
+ * returns 0 on success
+ */
+int sfs_remove(char *file); // removes a file from the filesystem
+
+/**
+ * creates an empty directory. paths name the directories leading to a file
+ * or directory separated by '/', starting from the root directory
+ * 
+ * returns -1 and sets errno to EEXIST if the path exists, ENOENT if its
+ * parent directory doesn't, or ENOSPC if no inode or block is left for it
+ * returns 0 on success
+ */
+int sfs_mkdir(char *path);
+
+/**
+ * removes an empty directory
+ * 
+ * returns -1 and sets errno to ENOENT if the path doesn't exist, ENOTDIR if
+ * it is not a directory, EBUSY if it is the root or ENOTEMPTY if it is not
+ * empty
  * returns 0 on success
  */
-int sfs_remove(char *file); // removes a file from the filesystem
\ No newline at end of file
+int sfs_rmdir(char *path);
\ No newline at end of file
@@ -0,0 +1,600 @@
+#include "common.h"
+#include "disk_emu.h"
+#include "block_cache.h"
+#include "io_sched.h"
+#include "journal.h"
+#include "dir_cache.h"
+#include "sfs_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// checks a disk of the file system once its journal is replayed: the super
+// block, every inode and the blocks it points to, the directories and their
+// index, and the free map against all of them. inodes no directory refers to
+// and blocks allocated without being referenced are freed and the overflow
+// counts of the index buckets are recomputed, the other problems are
+// reported only
+//
+// inodes are walked by several threads at once, each reading the indirect
+// block and the directory blocks of the inodes it takes. consecutive blocks
+// are read together
+//
+// usage: sfs_fsck [-n] [-j threads] [disk]
+//   -n          report the problems without repairing them or writing to the
+//               disk. the journal is replayed in memory only
+//   -j threads  number of threads walking the inodes, one per cpu by default
+//   disk        file holding the disk, emulated_disk by default
+
+#define FSCK_MAX_BLOCKS (12 + 256) // blocks an inode can point to
+
+// exit status, as other fsck tools report it
+#define FSCK_OK 0
+#define FSCK_REPAIRED 1
+#define FSCK_UNREPAIRED 4
+#define FSCK_FAILED 8
+
+// owners of a block besides inodes
+#define OWNER_NONE -1
+#define OWNER_INDEX -2
+
+// what the walk of an inode found
+typedef struct FSCK_INODE {
+    int blocks[FSCK_MAX_BLOCKS + 1]; // blocks pointed to, the indirect one too
+    int nblocks;
+    int refs; // directory entries referring to the inode
+    int nentries; // entries of a directory
+} FSCK_INODE;
+
+// a record in use in a directory
+typedef struct FSCK_ENTRY {
+    int dir;
+    int offset;
+    unsigned int hash;
+    int indexed; // found in the index
+} FSCK_ENTRY;
+
+static FSCK_INODE inodes[NUM_INODES];
+static int owner[NUM_BLOCKS]; // inode a block belongs to, or an OWNER_
+
+static FSCK_ENTRY *entries = NULL;
+static int nentries = 0;
+static int entries_size = 0;
+static pthread_mutex_t entries_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// next inode a thread takes
+static int next_inode = 0;
+
+static int readonly = 0;
+static int repaired = 0;
+static int unrepaired = 0;
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// prints a problem. it is counted as repaired if it can be and the check
+// isn't read only, in which case the caller repairs it
+// returns 1 if the problem is to be repaired, 0 otherwise
+static int report(int can_repair, const char *format, ...)
+{
+    va_list args;
+    int repair = can_repair && !readonly;
+
+    pthread_mutex_lock(&report_lock);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf(repair ? ", repaired\n" : "\n");
+    if (repair)
+        repaired++;
+    else
+        unrepaired++;
+    pthread_mutex_unlock(&report_lock);
+    return repair;
+}
+
+static int is_data_block(int address)
+{
+    return address >= FM_FIRST_DATA_BLOCK && address < NUM_BLOCKS;
+}
+
+// reads blocks from the disk, taking the copies a read only replay of the
+// journal kept in memory instead of the stale ones of the disk
+static void read_disk(int address, int nblocks, void *buf)
+{
+    io_read(address, nblocks, buf);
+    for (int i = 0; i < nblocks; i++)
+        jn_read(address + i, (char*) buf + i * BLOCK_SIZE);
+}
+
+// reads the blocks at the given addresses one after the other into buf,
+// consecutive addresses in a single request
+static void read_runs(const int *addresses, int n, char *buf)
+{
+    int i = 0;
+    while (i < n)
+    {
+        int run = 1;
+        while (i + run < n && addresses[i + run] == addresses[i] + run)
+            run++;
+        read_disk(addresses[i], run, buf + i * BLOCK_SIZE);
+        i += run;
+    }
+}
+
+static void add_entry(int dir, int offset, unsigned int hash)
+{
+    pthread_mutex_lock(&entries_lock);
+    if (nentries == entries_size)
+    {
+        entries_size = (entries_size == 0) ? 64 : 2 * entries_size;
+        entries = realloc(entries, entries_size * sizeof(FSCK_ENTRY));
+        if (entries == NULL)
+        {
+            printf("could not allocate the directory entries\n");
+            exit(FSCK_FAILED);
+        }
+    }
+    FSCK_ENTRY *entry = &(entries[nentries++]);
+    entry->dir = dir;
+    entry->offset = offset;
+    entry->hash = hash;
+    entry->indexed = 0;
+    pthread_mutex_unlock(&entries_lock);
+}
+
+// checks the records of every block of the directory within its size and
+// counts the references to the inodes they hold
+static void check_directory(int dir, const int *addresses, int size)
+{
+    int nblocks = size / BLOCK_SIZE;
+    if (size % BLOCK_SIZE != 0)
+        report(0, "directory %d: size %d is not a multiple of the block size", dir, size);
+
+    for (int i = 0; i < nblocks; i++)
+    {
+        if (addresses[i] == 0)
+        {
+            report(0, "directory %d: no block at index %d", dir, i);
+            return;
+        }
+    }
+
+    char *buf = malloc(nblocks * BLOCK_SIZE);
+    if (buf == NULL)
+    {
+        printf("could not allocate the blocks of directory %d\n", dir);
+        exit(FSCK_FAILED);
+    }
+    read_runs(addresses, nblocks, buf);
+
+    for (int i = 0; i < nblocks; i++)
+    {
+        char *block = buf + i * BLOCK_SIZE;
+        int pos = 0;
+        while (pos < BLOCK_SIZE)
+        {
+            DIR_RECORD *record = (DIR_RECORD*) (block + pos);
+            int offset = i * BLOCK_SIZE + pos;
+            if (record->rec_len < sizeof(DIR_RECORD) || record->rec_len % 4 != 0
+                    || pos + record->rec_len > BLOCK_SIZE)
+            {
+                report(0, "directory %d: bad record length at offset %d", dir, offset);
+                break;
+            }
+
+            if (record->inode_num != 0 && (record->name_len == 0
+                    || DIR_RECORD_LEN(record->name_len) > record->rec_len))
+            {
+                report(0, "directory %d: bad name length at offset %d", dir, offset);
+            }
+            else if (record->inode_num != 0)
+            {
+                char filename[MAX_FILENAME + 1];
+                memcpy(filename, record + 1, record->name_len);
+                filename[record->name_len] = '\0';
+
+                int inode_num = record->inode_num;
+                if (inode_num < 0 || inode_num >= NUM_INODES
+                        || inode_num == ROOT_DIR_INODE_NUM
+                        || !inode_table_cache[inode_num].valid)
+                {
+                    report(0, "directory %d: entry %s refers to invalid inode %d", dir,
+                            filename, inode_num);
+                }
+                else
+                {
+                    __atomic_fetch_add(&(inodes[inode_num].refs), 1, __ATOMIC_RELAXED);
+                }
+
+                __atomic_fetch_add(&(inodes[dir].nentries), 1, __ATOMIC_RELAXED);
+                add_entry(dir, offset, dc_hash(dir, filename));
+            }
+            pos += record->rec_len;
+        }
+    }
+    free(buf);
+}
+
+// checks the fields of the inode and collects the blocks it points to
+static void walk_inode(int inode_num)
+{
+    INODE *inode = &(inode_table_cache[inode_num]);
+    FSCK_INODE *info = &(inodes[inode_num]);
+    int addresses[FSCK_MAX_BLOCKS];
+
+    if (!inode->valid)
+        return;
+
+    if (inode->mode != MODE_FILE && inode->mode != MODE_DIR)
+        report(0, "inode %d: bad mode %d", inode_num, inode->mode);
+    if (inode->size < 0 || inode->size > FSCK_MAX_BLOCKS * BLOCK_SIZE)
+        report(0, "inode %d: bad size %d", inode_num, inode->size);
+
+    memcpy(addresses, inode->direct_ptr, sizeof(inode->direct_ptr));
+    memset(addresses + 12, 0, 256 * sizeof(int));
+    if (inode->ind_ptr != 0)
+    {
+        if (is_data_block(inode->ind_ptr))
+        {
+            info->blocks[info->nblocks++] = inode->ind_ptr;
+            read_disk(inode->ind_ptr, 1, addresses + 12);
+        }
+        else
+        {
+            report(0, "inode %d: bad indirect block %d", inode_num, inode->ind_ptr);
+        }
+    }
+
+    for (int i = 0; i < FSCK_MAX_BLOCKS; i++)
+    {
+        if (addresses[i] == 0)
+            continue;
+
+        if (is_data_block(addresses[i]))
+        {
+            info->blocks[info->nblocks++] = addresses[i];
+        }
+        else
+        {
+            report(0, "inode %d: bad block %d at index %d", inode_num, addresses[i], i);
+            addresses[i] = 0;
+        }
+    }
+
+    if (inode->mode == MODE_DIR && inode->size >= 0 && inode->size <= FSCK_MAX_BLOCKS * BLOCK_SIZE)
+        check_directory(inode_num, addresses, inode->size);
+}
+
+static void *walker(void *arg)
+{
+    int inode_num;
+    while ((inode_num = __atomic_fetch_add(&next_inode, 1, __ATOMIC_RELAXED)) < NUM_INODES)
+        walk_inode(inode_num);
+    return NULL;
+}
+
+// exits if the super block doesn't describe a disk of this file system
+static void check_super_block()
+{
+    char block_buf[BLOCK_SIZE];
+    SUPER_BLOCK *super_block = &super_block_cache;
+
+    read_disk(0, 1, block_buf);
+    *super_block = *((SUPER_BLOCK*) block_buf);
+
+    if (super_block->magic_number != SFS_MAGIC || super_block->block_size != BLOCK_SIZE
+            || super_block->fs_size != NUM_BLOCKS
+            || super_block->inode_table_length != INODE_TABLE_LENGTH
+            || super_block->root_dir_inode_num != ROOT_DIR_INODE_NUM)
+    {
+        printf("super block doesn't describe a disk of this file system\n");
+        exit(FSCK_FAILED);
+    }
+
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+    {
+        int address = super_block->dir_index[i];
+        if (!is_data_block(address))
+        {
+            printf("super block: bad directory index bucket %d\n", address);
+            exit(FSCK_FAILED);
+        }
+        owner[address] = OWNER_INDEX;
+    }
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const FSCK_ENTRY *x = a;
+    const FSCK_ENTRY *y = b;
+    if (x->dir != y->dir)
+        return (x->dir < y->dir) ? -1 : 1;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// frees the inodes no directory refers to, as long as they don't hold
+// entries of their own
+static void check_references()
+{
+    INODE *root = &(inode_table_cache[ROOT_DIR_INODE_NUM]);
+    if (!root->valid || root->mode != MODE_DIR)
+    {
+        printf("root directory is missing\n");
+        exit(FSCK_FAILED);
+    }
+
+    for (int i = 0; i < NUM_INODES; i++)
+    {
+        if (!inode_table_cache[i].valid || i == ROOT_DIR_INODE_NUM)
+            continue;
+
+        if (inodes[i].refs > 1)
+        {
+            report(0, "inode %d: in %d directory entries", i, inodes[i].refs);
+        }
+        else if (inodes[i].refs == 0)
+        {
+            if (inodes[i].nentries > 0)
+            {
+                report(0, "inode %d: directory with %d entries in no directory", i,
+                        inodes[i].nentries);
+            }
+            else if (report(1, "inode %d: in no directory", i))
+            {
+                inode_table_cache[i].valid = 0;
+                inode_to_disk(i);
+            }
+        }
+    }
+}
+
+// checks that no block belongs to two inodes
+static void check_blocks()
+{
+    for (int i = 0; i < NUM_INODES; i++)
+    {
+        if (!inode_table_cache[i].valid)
+            continue;
+
+        for (int j = 0; j < inodes[i].nblocks; j++)
+        {
+            int address = inodes[i].blocks[j];
+            if (owner[address] == OWNER_NONE)
+                owner[address] = i;
+            else if (owner[address] == OWNER_INDEX)
+                report(0, "inode %d: block %d belongs to the directory index", i, address);
+            else
+                report(0, "inode %d: block %d belongs to inode %d", i, address, owner[address]);
+        }
+    }
+}
+
+// checks that every entry of the index refers to a record with its hash and
+// that every record is indexed. the overflow count of each bucket must match
+// the entries whose probe from their home bucket passes it
+static void check_index()
+{
+    DIR_INDEX_BUCKET buckets[DIR_INDEX_BUCKETS];
+    int overflows[DIR_INDEX_BUCKETS] = { 0 };
+    read_runs(super_block_cache.dir_index, DIR_INDEX_BUCKETS, (char*) buckets);
+    qsort(entries, nentries, sizeof(FSCK_ENTRY), compare_entries);
+
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+    {
+        DIR_INDEX_BUCKET *bucket = &(buckets[i]);
+        if (bucket->count < 0 || bucket->count > DIR_INDEX_BUCKET_ENTRIES)
+        {
+            report(0, "index bucket %d: bad count %d", i, bucket->count);
+            continue;
+        }
+
+        for (int j = 0; j < bucket->count; j++)
+        {
+            DIR_INDEX_ENTRY *index_entry = &(bucket->entries[j]);
+            FSCK_ENTRY key = { .dir = index_entry->dir, .offset = index_entry->offset };
+            FSCK_ENTRY *entry = bsearch(&key, entries, nentries, sizeof(FSCK_ENTRY), compare_entries);
+            if (entry == NULL)
+            {
+                report(0, "index bucket %d: no entry at offset %d of directory %d", i,
+                        key.offset, key.dir);
+                continue;
+            }
+            if (entry->hash != index_entry->hash)
+            {
+                report(0, "index bucket %d: wrong hash for offset %d of directory %d", i,
+                        key.offset, key.dir);
+                continue;
+            }
+            if (entry->indexed)
+            {
+                report(0, "index bucket %d: offset %d of directory %d indexed twice", i,
+                        key.offset, key.dir);
+                continue;
+            }
+            entry->indexed = 1;
+
+            // lookups only probe past a bucket that overflowed
+            for (int k = entry->hash % DIR_INDEX_BUCKETS; k != i; k = (k + 1) % DIR_INDEX_BUCKETS)
+                overflows[k]++;
+        }
+    }
+
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++)
+    {
+        if (buckets[i].overflows != overflows[i]
+                && report(1, "index bucket %d: %d overflows counted, %d found", i,
+                    buckets[i].overflows, overflows[i]))
+        {
+            buckets[i].overflows = overflows[i];
+            jn_write(super_block_cache.dir_index[i], &(buckets[i]));
+        }
+    }
+
+    for (int i = 0; i < nentries; i++)
+    {
+        if (!entries[i].indexed)
+            report(0, "directory %d: entry at offset %d is not indexed", entries[i].dir,
+                    entries[i].offset);
+    }
+}
+
+// checks the free map against the blocks found in use, freeing the blocks
+// allocated to nothing and allocating the ones in use
+static void check_free_map()
+{
+    unsigned int freemap[BLOCK_SIZE / sizeof(unsigned int)];
+    int leaked = 0;
+    int changed = 0;
+
+    read_disk(FM_ADDRESS, 1, freemap);
+    for (int b = 0; b < FM_BITS; b++)
+    {
+        int address = FM_FIRST_DATA_BLOCK + b;
+        int allocated = (freemap[b / 32] >> (b % 32)) & 1;
+        int in_use = (owner[address] != OWNER_NONE);
+
+        if (allocated && !in_use)
+        {
+            leaked++;
+        }
+        else if (!allocated && in_use
+                && report(1, "block %d: in use but free in the free map", address))
+        {
+            freemap[b / 32] |= 1u << (b % 32);
+            changed = 1;
+        }
+    }
+
+    if (leaked > 0 && report(1, "free map: %d blocks allocated to nothing", leaked))
+    {
+        for (int b = 0; b < FM_BITS; b++)
+        {
+            if (owner[FM_FIRST_DATA_BLOCK + b] == OWNER_NONE)
+                freemap[b / 32] &= ~(1u << (b % 32));
+        }
+        changed = 1;
+    }
+
+    if (changed)
+        jn_write(FM_ADDRESS, freemap);
+
+    // the summaries saved on a clean unmount are checked against the map
+    // once repaired. the next mount rebuilds them if they are off
+    SUPER_BLOCK *super_block = &super_block_cache;
+    if (!super_block->clean)
+        return;
+
+    int stale = (repaired > 0);
+    for (int g = 0; g < FM_GROUPS; g++)
+    {
+        int free_blocks = 0;
+        for (int b = g * FM_GROUP_BITS; b < (g + 1) * FM_GROUP_BITS; b++)
+            free_blocks += !((freemap[b / 32] >> (b % 32)) & 1);
+        stale |= (free_blocks != super_block->free_blocks[g]);
+    }
+    for (int i = 0; i < NUM_INODES; i++)
+    {
+        int used = (super_block->used_inodes[i / 32] >> (i % 32)) & 1;
+        stale |= (used != inode_table_cache[i].valid);
+    }
+
+    if (stale && report(1, "super block: summaries out of date"))
+    {
+        super_block->clean = 0;
+        super_block_to_disk();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char *disk = "emulated_disk";
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "nj:")) != -1)
+    {
+        if (opt == 'n')
+        {
+            readonly = 1;
+        }
+        else if (opt == 'j' && atoi(optarg) > 0)
+        {
+            nthreads = atoi(optarg);
+        }
+        else
+        {
+            printf("usage: %s [-n] [-j threads] [disk]\n", argv[0]);
+            return FSCK_FAILED;
+        }
+    }
+    if (optind < argc)
+        disk = argv[optind];
+    if (nthreads < 1)
+        nthreads = 1;
+
+    io_init();
+    if (init_disk(disk, BLOCK_SIZE, NUM_BLOCKS) == -1)
+        return FSCK_FAILED;
+    bc_init();
+
+    // the disk is checked as of its last committed transaction
+    jn_recover(readonly);
+
+    for (int i = 0; i < NUM_BLOCKS; i++)
+        owner[i] = OWNER_NONE;
+    check_super_block();
+    load_inode_table(NULL);
+
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    if (threads == NULL)
+    {
+        printf("could not allocate the threads\n");
+        return FSCK_FAILED;
+    }
+    for (int i = 0; i < nthreads; i++)
+    {
+        if (pthread_create(&(threads[i]), NULL, walker, NULL) != 0)
+        {
+            printf("could not start the threads\n");
+            return FSCK_FAILED;
+        }
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    check_references();
+    check_blocks();
+    check_index();
+    check_free_map();
+
+    // the repairs are committed and written home
+    jn_unmount();
+    close_disk();
+
+    int files = 0;
+    int dirs = 0;
+    int blocks = 0;
+    for (int i = 0; i < NUM_INODES; i++)
+    {
+        if (inode_table_cache[i].valid)
+        {
+            if (inode_table_cache[i].mode == MODE_DIR)
+                dirs++;
+            else
+                files++;
+        }
+    }
+    for (int i = FM_FIRST_DATA_BLOCK; i < NUM_BLOCKS; i++)
+        blocks += (owner[i] != OWNER_NONE);
+
+    printf("%s: %d files, %d directories, %d/%d blocks in use\n", disk, files, dirs,
+            blocks, FM_BITS);
+    printf("%d problems repaired, %d left\n", repaired, unrepaired);
+
+    if (unrepaired > 0)
+        return FSCK_UNREPAIRED;
+    return (repaired > 0) ? FSCK_REPAIRED : FSCK_OK;
+}
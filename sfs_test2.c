@@ -13,6 +13,7 @@
  * change this if your implementation differs.
  */
 #define MAX_FILENAME 20   /* Assume at most 20 characters (16.3) */
+#define MAX_SFS_FILENAME 255 /* Longest name the file system accepts */
 
 /* The maximum number of files to attempt to open or create.  NOTE: we
  * do not _require_ that you support this many files. This is just to
@@ -82,10 +83,10 @@ main(int argc, char **argv)
   /* First we open two files and attempt to write data to them.
    */
   {
-  char fname[MAX_FILENAME+10];
+  char fname[MAX_SFS_FILENAME+10];
   int i;
 
-  for (i = 0; i < MAX_FILENAME+10; i++) {
+  for (i = 0; i < MAX_SFS_FILENAME+10; i++) {
     if (i != 8) {
       fname[i] = 'A' + (rand() % 26);
     }
@@ -0,0 +1,265 @@
+/* sfs_test3.c
+ *
+ * Crash recovery test. Each round, a child process mounts the disk, writes
+ * to a set of files and exits with the files still open and the file system
+ * still mounted, as if the machine had crashed. Another child then mounts
+ * the disk again, which replays the journal, and checks the files:
+ *
+ *  - a file synced with sfs_fsync has exactly the contents it was synced
+ *    with,
+ *  - every other file holds only its own bytes or zeros, never the bytes
+ *    of another file or of a block that was never written.
+ *
+ * If sfs_fsck has been built (make fsck), it is run on the crashed disk as
+ * well and must find no problems.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sfs_api.h"
+
+#define ROUNDS 20
+#define NFILES 12
+#define MAX_BYTES 40000 /* Past the direct blocks, so indirect ones are used */
+
+static char model[NFILES][MAX_BYTES];
+static int model_size[NFILES];
+static int synced[NFILES];
+
+/* The byte each file holds at each offset. It is never zero, so the holes
+ * can be told apart, and differs from file to file.
+ */
+static char pattern(int file, int off)
+{
+  return 'A' + (file * 7 + off) % 26;
+}
+
+static void file_name(int file, char *name)
+{
+  sprintf(name, "crash%02d.dat", file);
+}
+
+/* model_write() - record in the model that the pattern was written to the
+ * given range of the file.
+ */
+static void model_write(int file, int off, int length)
+{
+  int i;
+
+  if (off > model_size[file]) {
+    memset(model[file] + model_size[file], 0, off - model_size[file]);
+  }
+  for (i = 0; i < length; i++) {
+    model[file][off + i] = pattern(file, off + i);
+  }
+  if (off + length > model_size[file]) {
+    model_size[file] = off + length;
+  }
+}
+
+static void model_truncate(int file, int size)
+{
+  if (size > model_size[file]) {
+    memset(model[file] + model_size[file], 0, size - model_size[file]);
+  }
+  model_size[file] = size;
+}
+
+/* run_round() - the writes of a round. They depend only on the round
+ * number, so the checker computes the expected contents by running them
+ * again with apply set to 0, which only updates the model.
+ */
+static void run_round(int round, int apply)
+{
+  char name[32];
+  char buf[3000];
+  int fd = -1;
+  int i, j, k;
+
+  srand(round);
+  for (i = 0; i < NFILES; i++) {
+    if (apply) {
+      file_name(i, name);
+      fd = sfs_fopen(name);
+      sfs_ftruncate(fd, 0);
+    }
+    model_size[i] = 0;
+
+    int nops = 5 + rand() % 20;
+    for (j = 0; j < nops; j++) {
+      int op = rand() % 4;
+      int off, length;
+
+      if (op == 0 || op == 1) {
+        /* small writes, which go through the descriptor's buffer, either
+         * appended or past the end of the file
+         */
+        off = model_size[i] + (op == 1 ? rand() % 5000 : 0);
+        length = 1 + rand() % 300;
+      }
+      else if (op == 2) {
+        off = rand() % (model_size[i] + 1);
+        length = 1 + rand() % sizeof(buf);
+      }
+      else {
+        int size = rand() % (model_size[i] + 2000);
+        if (apply) {
+          sfs_ftruncate(fd, size);
+        }
+        model_truncate(i, size);
+        continue;
+      }
+
+      if (off + length > MAX_BYTES) {
+        continue;
+      }
+      if (apply) {
+        for (k = 0; k < length; k++) {
+          buf[k] = pattern(i, off + k);
+        }
+        if (op == 2) {
+          sfs_pwrite(fd, buf, length, off);
+        }
+        else {
+          sfs_fwseek(fd, off);
+          sfs_fwrite(fd, buf, length);
+        }
+      }
+      model_write(i, off, length);
+    }
+
+    /* the descriptor stays open whether the file is synced or not */
+    synced[i] = (rand() % 3 == 0);
+    if (apply && synced[i]) {
+      sfs_fsync(fd);
+    }
+  }
+}
+
+/* check_round() - compare the files on the remounted disk with the model
+ * and return the number of errors found.
+ */
+static int check_round(int round)
+{
+  char name[32];
+  static char buffer[MAX_BYTES];
+  int error_count = 0;
+  int i, j;
+
+  run_round(round, 0);
+
+  for (i = 0; i < NFILES; i++) {
+    file_name(i, name);
+    int size = sfs_getfilesize(name);
+    if (size < 0 && !synced[i]) {
+      continue; /* created after the last commit */
+    }
+    if (size < 0 || size > MAX_BYTES) {
+      fprintf(stderr, "ERROR: round %d: %s has size %d\n", round, name, size);
+      error_count++;
+      continue;
+    }
+    if (synced[i] && size != model_size[i]) {
+      fprintf(stderr, "ERROR: round %d: synced %s has size %d, expected %d\n",
+              round, name, size, model_size[i]);
+      error_count++;
+      continue;
+    }
+
+    int fd = sfs_fopen(name);
+    int n = sfs_pread(fd, buffer, size, 0);
+    if (n != size) {
+      fprintf(stderr, "ERROR: round %d: read %d bytes of %s, expected %d\n",
+              round, n, name, size);
+      error_count++;
+    }
+
+    for (j = 0; j < n; j++) {
+      if (synced[i] ? buffer[j] != model[i][j]
+          : buffer[j] != pattern(i, j) && buffer[j] != 0) {
+        fprintf(stderr, "ERROR: round %d: wrong byte in %s at position %d (%d)\n",
+                round, name, j, buffer[j]);
+        error_count++;
+        break;
+      }
+    }
+    sfs_fclose(fd);
+  }
+
+  return error_count;
+}
+
+/* run_child() - run func in a child process and return its exit status.
+ */
+static int run_child(int (*func)(int), int round)
+{
+  int status;
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    _exit(func(round));
+  }
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+    return -1;
+  }
+  return WEXITSTATUS(status);
+}
+
+static int crash(int round)
+{
+  mksfs(round == 0);
+  run_round(round, 1);
+  return 0; /* without closing the files or unmounting */
+}
+
+static int recover(int round)
+{
+  mksfs(0);
+  int error_count = check_round(round);
+
+  /* the next round mounts a cleanly unmounted disk half the time */
+  if (round % 2 == 0) {
+    sfs_unmount();
+  }
+  return (error_count > 255) ? 255 : error_count;
+}
+
+/* The main testing program
+ */
+int
+main(int argc, char **argv)
+{
+  int error_count = 0;
+  int have_fsck = (access("./sfs_fsck", X_OK) == 0);
+  int round;
+
+  if (!have_fsck) {
+    printf("sfs_fsck not built, the disk won't be checked with it\n");
+  }
+
+  for (round = 0; round < ROUNDS; round++) {
+    if (run_child(crash, round) != 0) {
+      fprintf(stderr, "ERROR: round %d: writer failed\n", round);
+      error_count++;
+      continue;
+    }
+
+    if (have_fsck && system("./sfs_fsck -n > /dev/null") != 0) {
+      fprintf(stderr, "ERROR: round %d: sfs_fsck found problems after the crash\n",
+              round);
+      error_count++;
+    }
+
+    int errors = run_child(recover, round);
+    if (errors != 0) {
+      fprintf(stderr, "ERROR: round %d: recovery check failed\n", round);
+      error_count += (errors > 0) ? errors : 1;
+    }
+  }
+
+  fprintf(stderr, "Test program exiting with %d errors\n", error_count);
+  return (error_count);
+}
@@ -0,0 +1,444 @@
+/* sfs_test4.c
+ *
+ * Tests of the file operations added on top of the course API. Each test
+ * works on files of its own and returns the number of errors it found.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sfs_api.h"
+
+#define BLOCK 1024 /* Block size of the file system */
+#define MAX_FNAME 256 /* Longest filename of the file system and its null */
+
+/* check_file() - read the whole file and compare it with expected, which
+ * holds length bytes. the file's size must be length.
+ */
+static int check_file(int fd, const char *name, const char *expected, int length)
+{
+  char *buffer;
+  int error_count = 0;
+  int i, n;
+
+  if (sfs_getfilesize(name) != length) {
+    fprintf(stderr, "ERROR: %s has size %d, expected %d\n", name,
+            sfs_getfilesize(name), length);
+    return 1;
+  }
+
+  if ((buffer = malloc(length + 1)) == NULL) {
+    fprintf(stderr, "ABORT: Out of memory!\n");
+    exit(-1);
+  }
+  n = sfs_pread(fd, buffer, length + 1, 0);
+  if (n != length) {
+    fprintf(stderr, "ERROR: read %d bytes of %s, expected %d\n", n, name, length);
+    error_count++;
+  }
+  for (i = 0; i < n && i < length; i++) {
+    if (buffer[i] != expected[i]) {
+      fprintf(stderr, "ERROR: wrong byte in %s at position %d (%d,%d)\n",
+              name, i, buffer[i], expected[i]);
+      error_count++;
+      break;
+    }
+  }
+  free(buffer);
+  return error_count;
+}
+
+/* expect() - report an error if value isn't what was expected.
+ */
+static int expect(const char *what, int value, int expected)
+{
+  if (value != expected) {
+    fprintf(stderr, "ERROR: %s returned %d, expected %d\n", what, value, expected);
+    return 1;
+  }
+  return 0;
+}
+
+/* test_vectored() - sfs_fwritev writes its buffers one after the other from
+ * the write pointer and sfs_freadv fills its buffers in order from the read
+ * pointer, both moving the pointer past the data.
+ */
+static int test_vectored()
+{
+  char *name = "vectored.dat";
+  static char model[4 * BLOCK];
+  static char payload[2 * BLOCK];
+  char header[16], trailer[16];
+  struct iovec iov[3];
+  int error_count = 0;
+  int fd, i, size;
+
+  fd = sfs_fopen(name);
+  for (i = 0; i < sizeof(payload); i++) {
+    payload[i] = 'a' + i % 26;
+  }
+
+  /* a record of header, payload and trailer spanning three blocks, written
+   * after a few bytes so the payload starts in the middle of a block
+   */
+  error_count += expect("write", sfs_fwrite(fd, "start", 5), 5);
+  memcpy(model, "start", 5);
+  memcpy(header, "HEADER", 6);
+  memcpy(trailer, "TRAILER", 7);
+  iov[0].iov_base = header;
+  iov[0].iov_len = 6;
+  iov[1].iov_base = payload;
+  iov[1].iov_len = sizeof(payload);
+  iov[2].iov_base = trailer;
+  iov[2].iov_len = 7;
+  error_count += expect("sfs_fwritev", sfs_fwritev(fd, iov, 3), 6 + sizeof(payload) + 7);
+  memcpy(model + 5, header, 6);
+  memcpy(model + 11, payload, sizeof(payload));
+  memcpy(model + 11 + sizeof(payload), trailer, 7);
+  size = 18 + sizeof(payload);
+  error_count += check_file(fd, name, model, size);
+
+  /* the write pointer is after the record */
+  error_count += expect("write after sfs_fwritev", sfs_fwrite(fd, "end", 3), 3);
+  memcpy(model + size, "end", 3);
+  size += 3;
+  error_count += check_file(fd, name, model, size);
+
+  /* the record reads back into buffers of the same sizes */
+  memset(payload, 0, sizeof(payload));
+  memset(header, 0, sizeof(header));
+  memset(trailer, 0, sizeof(trailer));
+  sfs_frseek(fd, 5);
+  error_count += expect("sfs_freadv", sfs_freadv(fd, iov, 3), 6 + sizeof(payload) + 7);
+  error_count += expect("header read", memcmp(header, model + 5, 6), 0);
+  error_count += expect("payload read", memcmp(payload, model + 11, sizeof(payload)), 0);
+  error_count += expect("trailer read", memcmp(trailer, model + 11 + sizeof(payload), 7),
+                        0);
+
+  /* the read pointer is after the record, so only "end" is left */
+  iov[0].iov_len = 2;
+  iov[1].iov_len = 2;
+  error_count += expect("sfs_freadv at the end", sfs_freadv(fd, iov, 3), 3);
+  error_count += expect("end read", memcmp(header, "en", 2) || payload[0] != 'd', 0);
+  error_count += expect("sfs_freadv past the end", sfs_freadv(fd, iov, 3), 0);
+
+  /* empty buffers are skipped */
+  iov[0].iov_len = 0;
+  iov[2].iov_len = 0;
+  sfs_frseek(fd, 0);
+  error_count += expect("sfs_freadv with empty buffers", sfs_freadv(fd, iov, 3), 2);
+  error_count += expect("read into the middle buffer", memcmp(payload, "st", 2), 0);
+  error_count += expect("sfs_fwritev of a closed file", sfs_fwritev(fd + 1, iov, 3), -1);
+  sfs_fclose(fd);
+
+  return error_count;
+}
+
+/* test_positional() - sfs_pread and sfs_pwrite work at the offset they are
+ * given and leave the descriptor's read and write pointers alone.
+ */
+static int test_positional()
+{
+  char *name = "positional.dat";
+  static char model[3 * BLOCK];
+  char buffer[16];
+  int error_count = 0;
+  int fd;
+
+  fd = sfs_fopen(name);
+  error_count += expect("write", sfs_fwrite(fd, "abc", 3), 3);
+  memcpy(model, "abc", 3);
+
+  /* a write past the end leaves a hole, across a block boundary */
+  error_count += expect("sfs_pwrite past the end",
+                        sfs_pwrite(fd, "positional", 10, BLOCK - 4), 10);
+  memcpy(model + BLOCK - 4, "positional", 10);
+  error_count += check_file(fd, name, model, BLOCK + 6);
+
+  /* the write pointer is still after "abc" */
+  error_count += expect("write after sfs_pwrite", sfs_fwrite(fd, "def", 3), 3);
+  memcpy(model + 3, "def", 3);
+  error_count += check_file(fd, name, model, BLOCK + 6);
+
+  /* and the read pointer still at the start */
+  error_count += expect("sfs_pread", sfs_pread(fd, buffer, 4, BLOCK - 2), 4);
+  error_count += expect("sfs_pread contents", memcmp(buffer, "sition", 4), 0);
+  error_count += expect("read after sfs_pread", sfs_fread(fd, buffer, 6), 6);
+  error_count += expect("read contents", memcmp(buffer, "abcdef", 6), 0);
+
+  /* reads stop at the end of the file */
+  error_count += expect("sfs_pread over the end", sfs_pread(fd, buffer, 16, BLOCK),
+                        6);
+  error_count += expect("sfs_pread at the end", sfs_pread(fd, buffer, 16, BLOCK + 6),
+                        0);
+  error_count += expect("sfs_pread past the end",
+                        sfs_pread(fd, buffer, 16, 2 * BLOCK), 0);
+
+  error_count += expect("sfs_pwrite at a negative offset",
+                        sfs_pwrite(fd, "x", 1, -1), -1);
+  error_count += expect("sfs_pread at a negative offset",
+                        sfs_pread(fd, buffer, 1, -1), -1);
+  error_count += expect("sfs_pread of a closed file", sfs_pread(fd + 1, buffer, 1, 0),
+                        -1);
+  sfs_fclose(fd);
+
+  return error_count;
+}
+
+/* test_sparse() - writes past the end of a file leave holes, which read
+ * back as zeros, are skipped by sfs_fseekdata and found by sfs_fseekhole,
+ * and survive a remount.
+ */
+static int test_sparse()
+{
+  char *name = "sparse.dat";
+  static char model[21 * BLOCK];
+  int error_count = 0;
+  int fd, size;
+
+  fd = sfs_fopen(name);
+
+  /* a hole of five blocks and a bit, then data */
+  sfs_fwseek(fd, 5 * BLOCK + 100);
+  error_count += expect("write after a hole", sfs_fwrite(fd, "data", 4), 4);
+  memcpy(model + 5 * BLOCK + 100, "data", 4);
+  size = 5 * BLOCK + 104;
+  error_count += check_file(fd, name, model, size);
+  error_count += expect("sfs_fseekdata from 0", sfs_fseekdata(fd, 0), 5 * BLOCK);
+  error_count += expect("sfs_fseekhole from 0", sfs_fseekhole(fd, 0), 0);
+  error_count += expect("sfs_fseekhole in the data", sfs_fseekhole(fd, 5 * BLOCK),
+                        size);
+
+  /* a small write in the middle of the hole fills one block of it */
+  sfs_fwseek(fd, 2 * BLOCK + 10);
+  error_count += expect("write in a hole", sfs_fwrite(fd, "filled", 6), 6);
+  memcpy(model + 2 * BLOCK + 10, "filled", 6);
+  error_count += expect("sfs_fseekdata before the filled block",
+                        sfs_fseekdata(fd, 0), 2 * BLOCK);
+  error_count += expect("sfs_fseekhole after the filled block",
+                        sfs_fseekhole(fd, 2 * BLOCK), 3 * BLOCK);
+
+  /* a hole reaching the blocks of the indirect block */
+  error_count += expect("sfs_pwrite after a hole",
+                        sfs_pwrite(fd, "far", 3, 20 * BLOCK), 3);
+  memcpy(model + 20 * BLOCK, "far", 3);
+  size = 20 * BLOCK + 3;
+  error_count += expect("sfs_fseekhole after the data", sfs_fseekhole(fd, 5 * BLOCK),
+                        6 * BLOCK);
+  error_count += expect("sfs_fseekdata in the last hole", sfs_fseekdata(fd, 6 * BLOCK),
+                        20 * BLOCK);
+  error_count += check_file(fd, name, model, size);
+
+  /* the holes are still there once the disk is mounted again */
+  sfs_fclose(fd);
+  mksfs(0);
+  fd = sfs_fopen(name);
+  error_count += check_file(fd, name, model, size);
+  error_count += expect("sfs_fseekdata after remounting", sfs_fseekdata(fd, 3 * BLOCK),
+                        5 * BLOCK);
+  sfs_fclose(fd);
+
+  return error_count;
+}
+
+/* test_truncate() - sfs_ftruncate cuts a file in place and grows it with a
+ * hole, without bringing old data back or moving the descriptor's pointers.
+ */
+static int test_truncate()
+{
+  char *name = "truncate.dat";
+  static char model[31 * BLOCK];
+  int error_count = 0;
+  int fd, i;
+
+  fd = sfs_fopen(name);
+  for (i = 0; i < 30 * BLOCK; i++) {
+    model[i] = 'a' + i % 26;
+  }
+  error_count += expect("write", sfs_fwrite(fd, model, 30 * BLOCK), 30 * BLOCK);
+
+  /* shrinking past the indirect block keeps the start of the file */
+  error_count += expect("shrink", sfs_ftruncate(fd, 10 * BLOCK + 500), 0);
+  error_count += check_file(fd, name, model, 10 * BLOCK + 500);
+
+  /* growing again leaves zeros, the cut part of the last block included */
+  error_count += expect("grow", sfs_ftruncate(fd, 15 * BLOCK), 0);
+  memset(model + 10 * BLOCK + 500, 0, 5 * BLOCK - 500);
+  error_count += check_file(fd, name, model, 15 * BLOCK);
+  error_count += expect("sfs_fseekhole after growing", sfs_fseekhole(fd, 10 * BLOCK),
+                        11 * BLOCK);
+
+  /* a write reaching past the new end is cut along with the rest */
+  sfs_fwseek(fd, 50);
+  sfs_fwrite(fd, "buffered", 8);
+  error_count += expect("shrink over a buffered write", sfs_ftruncate(fd, 54), 0);
+  memcpy(model + 50, "buff", 4);
+  error_count += check_file(fd, name, model, 54);
+
+  /* the write pointer stays where it was, past the new end */
+  sfs_fwrite(fd, "end", 3);
+  memset(model + 54, 0, 4);
+  memcpy(model + 58, "end", 3);
+  error_count += check_file(fd, name, model, 61);
+
+  error_count += expect("negative size", sfs_ftruncate(fd, -1), -1);
+  error_count += expect("size too large", sfs_ftruncate(fd, 269 * BLOCK), -1);
+
+  /* the new size is on disk */
+  sfs_fclose(fd);
+  mksfs(0);
+  fd = sfs_fopen(name);
+  error_count += check_file(fd, name, model, 61);
+  error_count += expect("shrink to 0", sfs_ftruncate(fd, 0), 0);
+  error_count += check_file(fd, name, model, 0);
+  sfs_fclose(fd);
+
+  return error_count;
+}
+
+/* expect_errno() - report an error unless the call failed with the given
+ * errno.
+ */
+static int expect_errno(const char *what, int value, int expected)
+{
+  if (value != -1 || errno != expected) {
+    fprintf(stderr, "ERROR: %s returned %d with errno %d, expected -1 with %d\n",
+            what, value, errno, expected);
+    return 1;
+  }
+  return 0;
+}
+
+/* test_subdirs() - files with the same name in different directories are
+ * different files, directories list what they hold, and only empty ones
+ * can be removed.
+ */
+static int test_subdirs()
+{
+  static char *names[] = { "/same.dat", "/dir/same.dat", "/dir/sub/same.dat" };
+  char fname[MAX_FNAME];
+  char contents[3][16];
+  int error_count = 0;
+  int fd, i, next, count, inode_num, size, is_dir;
+
+  error_count += expect("sfs_mkdir", sfs_mkdir("/dir"), 0);
+  error_count += expect("sfs_mkdir in a directory", sfs_mkdir("/dir/sub"), 0);
+  error_count += expect_errno("sfs_mkdir of an existing directory", sfs_mkdir("/dir"),
+                              EEXIST);
+  error_count += expect_errno("sfs_mkdir in a missing directory",
+                              sfs_mkdir("/missing/sub"), ENOENT);
+  error_count += expect("sfs_isdir", sfs_isdir("/dir/sub"), 1);
+
+  for (i = 0; i < 3; i++) {
+    sprintf(contents[i], "contents %d", i);
+    fd = sfs_fopen(names[i]);
+    error_count += expect("write", sfs_fwrite(fd, contents[i], strlen(contents[i])),
+                          strlen(contents[i]));
+    sfs_fclose(fd);
+  }
+  error_count += expect("sfs_isdir of a file", sfs_isdir("/dir/same.dat"), 0);
+  error_count += expect_errno("sfs_fopen of a directory", sfs_fopen("/dir/sub"),
+                              EISDIR);
+  error_count += expect_errno("sfs_fopen below a file", sfs_fopen("/dir/same.dat/x"),
+                              ENOTDIR);
+
+  /* the listing of /dir has the file and the subdirectory */
+  count = 0;
+  for (next = 0; (next = sfs_readdirplus("/dir", next, fname, &inode_num, &size,
+                                         &is_dir)) > 0; ) {
+    if (!(strcmp(fname, "sub") == 0 && is_dir)
+        && !(strcmp(fname, "same.dat") == 0 && !is_dir && size == 10)) {
+      fprintf(stderr, "ERROR: unexpected entry %s in /dir\n", fname);
+      error_count++;
+    }
+    count++;
+  }
+  error_count += expect("entries listed in /dir", count, 2);
+  error_count += expect("sfs_readdir of a file", sfs_readdir("/same.dat", 0, fname), -1);
+
+  error_count += expect_errno("sfs_rmdir of a directory that is not empty",
+                              sfs_rmdir("/dir"), ENOTEMPTY);
+  error_count += expect_errno("sfs_rmdir of a file", sfs_rmdir("/dir/same.dat"),
+                              ENOTDIR);
+  error_count += expect_errno("sfs_rmdir of the root", sfs_rmdir("/"), EBUSY);
+  error_count += expect_errno("sfs_remove of a directory", sfs_remove("/dir/sub"),
+                              EISDIR);
+
+  /* each file kept its own contents, also once the disk is mounted again */
+  mksfs(0);
+  for (i = 0; i < 3; i++) {
+    fd = sfs_fopen(names[i]);
+    error_count += check_file(fd, names[i], contents[i], strlen(contents[i]));
+    sfs_fclose(fd);
+  }
+
+  error_count += expect("sfs_remove in a directory", sfs_remove("/dir/sub/same.dat"), 0);
+  error_count += expect("sfs_rmdir of an empty directory", sfs_rmdir("/dir/sub"), 0);
+  error_count += expect("sfs_isdir of a removed directory", sfs_isdir("/dir/sub"), -1);
+  error_count += expect("sfs_getfilesize of a file in a removed directory",
+                        sfs_getfilesize("/dir/sub/same.dat"), -1);
+  fd = sfs_fopen("/dir/same.dat");
+  error_count += check_file(fd, "/dir/same.dat", contents[1], strlen(contents[1]));
+  sfs_fclose(fd);
+
+  return error_count;
+}
+
+/* test_unmount() - unmounting writes out what files still open hold in
+ * their write buffers, holes included, and can be done more than once.
+ */
+static int test_unmount()
+{
+  char *name = "unmount.dat";
+  static char model[3 * BLOCK];
+  int error_count = 0;
+  int fd;
+
+  fd = sfs_fopen(name);
+  error_count += expect("write", sfs_fwrite(fd, "start", 5), 5);
+  memcpy(model, "start", 5);
+  sfs_fwseek(fd, 2 * BLOCK + 7);
+  error_count += expect("write in a hole", sfs_fwrite(fd, "buffered", 8), 8);
+  memcpy(model + 2 * BLOCK + 7, "buffered", 8);
+
+  sfs_unmount();
+  sfs_unmount();
+  mksfs(0);
+  fd = sfs_fopen(name);
+  error_count += check_file(fd, name, model, 2 * BLOCK + 15);
+  sfs_fclose(fd);
+
+  return error_count;
+}
+
+/* The main testing program
+ */
+int
+main(int argc, char **argv)
+{
+  int error_count = 0;
+
+  mksfs(1);                     /* Initialize the file system. */
+
+  printf("Vectored reads and writes\n");
+  error_count += test_vectored();
+
+  printf("Positional reads and writes\n");
+  error_count += test_positional();
+
+  printf("Sparse files\n");
+  error_count += test_sparse();
+
+  printf("Truncation\n");
+  error_count += test_truncate();
+
+  printf("Subdirectories\n");
+  error_count += test_subdirs();
+
+  printf("Unmounting with open files\n");
+  error_count += test_unmount();
+
+  fprintf(stderr, "Test program exiting with %d errors\n", error_count);
+  return (error_count);
+}
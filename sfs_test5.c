@@ -0,0 +1,326 @@
+/* sfs_test5.c
+ *
+ * sfs_fsck test, build it first with make fsck.
+ *
+ * A disk left by a crash holds changes only committed to its journal.
+ * sfs_fsck -n must find it consistent without writing to it, sfs_fsck
+ * replays the journal.
+ *
+ * A disk is then made with a few files, unmounted, and damaged by writing its
+ * blocks directly. sfs_fsck -n must find the damage without repairing it,
+ * sfs_fsck must repair it, and a second run must find the disk consistent.
+ * The files must still read back once the repaired disk is mounted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "disk_emu.h"
+#include "sfs_api.h"
+
+/* sfs_fsck exit statuses */
+#define FSCK_OK 0
+#define FSCK_REPAIRED 1
+#define FSCK_UNREPAIRED 4
+
+#define NFILES 4
+#define FILE_BYTES 20000
+#define ORPHAN_INODE (NUM_INODES - 1) /* never used by this test's files */
+
+static char file_names[NFILES][32];
+
+static char pattern(int file, int off)
+{
+  return 'A' + (file * 5 + off) % 26;
+}
+
+/* run_child() - run func in a child process and return its exit status,
+ * so each mount starts from a fresh process.
+ */
+static int run_child(int (*func)(int), int arg)
+{
+  int status;
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    _exit(func(arg));
+  }
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+    return -1;
+  }
+  return WEXITSTATUS(status);
+}
+
+/* run_fsck() - run sfs_fsck on emulated_disk with the given options and
+ * return its exit status.
+ */
+static int run_fsck(const char *options)
+{
+  char command[64];
+  int status;
+
+  sprintf(command, "./sfs_fsck %s > /dev/null", options);
+  status = system(command);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int expect_fsck(const char *options, int expected)
+{
+  int status = run_fsck(options);
+
+  if (status != expected) {
+    fprintf(stderr, "ERROR: sfs_fsck %s exited with %d, expected %d\n",
+            options, status, expected);
+    return 1;
+  }
+  return 0;
+}
+
+/* disk_hash() - hash of the whole emulated_disk file, to tell whether it
+ * was written to.
+ */
+static unsigned int disk_hash(void)
+{
+  unsigned int hash = 2166136261u;
+  FILE *fp = fopen("emulated_disk", "rb");
+  int c;
+
+  if (fp == NULL) {
+    fprintf(stderr, "ABORT: could not open emulated_disk\n");
+    exit(-1);
+  }
+  while ((c = getc(fp)) != EOF) {
+    hash = (hash ^ c) * 16777619u;
+  }
+  fclose(fp);
+  return hash;
+}
+
+/* write_files() - format the disk and write the files. the last file is
+ * in a subdirectory. returns 0 on success.
+ */
+static int write_files(void)
+{
+  static char buffer[FILE_BYTES];
+  int i, j;
+
+  mksfs(1);
+  sfs_mkdir("/sub");
+  for (i = 0; i < NFILES; i++) {
+    int fd = sfs_fopen(file_names[i]);
+    for (j = 0; j < FILE_BYTES; j++) {
+      buffer[j] = pattern(i, j);
+    }
+    if (sfs_fwrite(fd, buffer, FILE_BYTES) != FILE_BYTES) {
+      return 1;
+    }
+    sfs_fclose(fd);
+  }
+  return 0;
+}
+
+/* crash_disk() - write the files and commit them to the journal, then exit
+ * without unmounting, as if the machine had crashed.
+ */
+static int crash_disk(int unused)
+{
+  if (write_files() != 0 || sfs_sync() != 0) {
+    return 1;
+  }
+  return 0;
+}
+
+/* make_disk() - write the files and unmount cleanly. the inode number of
+ * the first file, found by listing the root directory, is written to out.
+ */
+static int make_disk(int out)
+{
+  char fname[MAX_FILENAME + 1];
+  int inode_num, size, is_dir;
+  int first = -1;
+  int next;
+
+  if (write_files() != 0) {
+    return 1;
+  }
+  for (next = 0; (next = sfs_readdirplus("/", next, fname, &inode_num, &size,
+                                         &is_dir)) > 0; ) {
+    if (strcmp(fname, file_names[0] + 1) == 0) {
+      first = inode_num;
+    }
+  }
+
+  sfs_unmount();
+  if (first == -1 || write(out, &first, sizeof(first)) != sizeof(first)) {
+    return 1;
+  }
+  return 0;
+}
+
+/* check_disk() - mount the disk and count the files that don't read back
+ * as written. a new file is written as well, so a block handed out twice
+ * would damage one of the old ones.
+ */
+static int check_disk(int unused)
+{
+  static char buffer[FILE_BYTES];
+  int error_count = 0;
+  int i, j;
+
+  mksfs(0);
+
+  int fd = sfs_fopen("/new.dat");
+  for (j = 0; j < FILE_BYTES; j++) {
+    buffer[j] = 'z';
+  }
+  if (sfs_fwrite(fd, buffer, FILE_BYTES) != FILE_BYTES) {
+    fprintf(stderr, "ERROR: could not write a new file\n");
+    error_count++;
+  }
+  sfs_fclose(fd);
+
+  for (i = 0; i < NFILES; i++) {
+    fd = sfs_fopen(file_names[i]);
+    if (sfs_pread(fd, buffer, FILE_BYTES, 0) != FILE_BYTES) {
+      fprintf(stderr, "ERROR: short read of %s\n", file_names[i]);
+      error_count++;
+    }
+    for (j = 0; j < FILE_BYTES; j++) {
+      if (buffer[j] != pattern(i, j)) {
+        fprintf(stderr, "ERROR: wrong byte in %s at position %d\n",
+                file_names[i], j);
+        error_count++;
+        break;
+      }
+    }
+    sfs_fclose(fd);
+  }
+
+  sfs_unmount();
+  return error_count;
+}
+
+/* check_in_child() - run check_disk in a child process and return the
+ * number of errors it found.
+ */
+static int check_in_child(void)
+{
+  int errors = run_child(check_disk, 0);
+
+  if (errors < 0) {
+    fprintf(stderr, "ERROR: the check of the files failed\n");
+    return 1;
+  }
+  return errors;
+}
+
+/* damage_disk() - make the problems sfs_fsck repairs: a block of a file
+ * marked free, blocks allocated to nothing, an inode in no directory and a
+ * wrong overflow count in the directory index.
+ */
+static void damage_disk(int inode_num)
+{
+  unsigned int freemap[BLOCK_SIZE / sizeof(unsigned int)];
+  char block[BLOCK_SIZE];
+  SUPER_BLOCK *super_block = (SUPER_BLOCK*) block;
+  INODE inode;
+  int per_block = BLOCK_SIZE / sizeof(INODE);
+  int b;
+
+  init_disk("emulated_disk", BLOCK_SIZE, NUM_BLOCKS);
+
+  read_blocks(1 + inode_num / per_block, 1, block);
+  memcpy(&inode, block + (inode_num % per_block) * sizeof(INODE), sizeof(INODE));
+
+  read_blocks(FM_ADDRESS, 1, freemap);
+  b = inode.direct_ptr[0] - FM_FIRST_DATA_BLOCK;
+  freemap[b / 32] &= ~(1u << (b % 32));
+  for (b = FM_BITS - 10; b < FM_BITS; b++) {
+    freemap[b / 32] |= 1u << (b % 32);
+  }
+  write_blocks(FM_ADDRESS, 1, freemap);
+
+  read_blocks(1 + ORPHAN_INODE / per_block, 1, block);
+  memset(&inode, 0, sizeof(INODE));
+  inode.valid = 1;
+  inode.mode = MODE_FILE;
+  inode.link_count = 1;
+  inode.free_block = -1;
+  memcpy(block + (ORPHAN_INODE % per_block) * sizeof(INODE), &inode, sizeof(INODE));
+  write_blocks(1 + ORPHAN_INODE / per_block, 1, block);
+
+  read_blocks(0, 1, block);
+  int bucket_address = super_block->dir_index[0];
+  read_blocks(bucket_address, 1, block);
+  ((DIR_INDEX_BUCKET*) block)->overflows += 3;
+  write_blocks(bucket_address, 1, block);
+
+  close_disk();
+}
+
+/* The main testing program
+ */
+int
+main(int argc, char **argv)
+{
+  int error_count = 0;
+  int inode_num;
+  int pipe_fds[2];
+  unsigned int hash;
+  int i;
+
+  if (access("./sfs_fsck", X_OK) != 0) {
+    fprintf(stderr, "ABORT: build sfs_fsck first with make fsck\n");
+    exit(-1);
+  }
+
+  for (i = 0; i < NFILES; i++) {
+    sprintf(file_names[i], (i == NFILES - 1) ? "/sub/file%d.dat" : "/file%d.dat", i);
+  }
+
+  printf("Checking a crashed disk\n");
+  if (run_child(crash_disk, 0) != 0) {
+    fprintf(stderr, "ABORT: could not make the disk\n");
+    exit(-1);
+  }
+  hash = disk_hash();
+  error_count += expect_fsck("-n", FSCK_OK);
+  if (disk_hash() != hash) {
+    fprintf(stderr, "ERROR: sfs_fsck -n wrote to the disk\n");
+    error_count++;
+  }
+  error_count += expect_fsck("", FSCK_OK);
+  if (disk_hash() == hash) {
+    fprintf(stderr, "ERROR: sfs_fsck didn't replay the journal\n");
+    error_count++;
+  }
+  error_count += check_in_child();
+
+  printf("Checking a consistent disk\n");
+  if (pipe(pipe_fds) != 0 || run_child(make_disk, pipe_fds[1]) != 0
+      || read(pipe_fds[0], &inode_num, sizeof(inode_num)) != sizeof(inode_num)) {
+    fprintf(stderr, "ABORT: could not make the disk\n");
+    exit(-1);
+  }
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  error_count += expect_fsck("", FSCK_OK);
+  error_count += expect_fsck("-j 1", FSCK_OK);
+
+  printf("Checking a damaged disk\n");
+  damage_disk(inode_num);
+  error_count += expect_fsck("-n", FSCK_UNREPAIRED);
+  error_count += expect_fsck("-n", FSCK_UNREPAIRED); /* -n changed nothing */
+  error_count += expect_fsck("", FSCK_REPAIRED);
+  error_count += expect_fsck("", FSCK_OK);
+
+  printf("Reading the repaired disk\n");
+  error_count += check_in_child();
+  error_count += expect_fsck("", FSCK_OK);
+
+  fprintf(stderr, "Test program exiting with %d errors\n", error_count);
+  return (error_count);
+}
@@ -1,142 +1,540 @@
 #include "common.h"
 #include "sfs_util.h"
-#include "root_dir_cache.h"
-#include "disk_emu.h"
+#include "dir_cache.h"
+#include "block_cache.h"
+#include "io_sched.h"
+#include "journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
 
+SUPER_BLOCK super_block_cache;
 
-int fm_is_available(int blocks_requested)
+INODE inode_table_cache[NUM_INODES];
+
+// one lock per inode, ordering the reads and writes of its contents
+static pthread_rwlock_t inode_locks[NUM_INODES] = {
+    [0 ... NUM_INODES - 1] = PTHREAD_RWLOCK_INITIALIZER
+};
+
+// sequence counts of the inode sizes, odd while a size is being changed.
+// readers of a size retry until they see the same even count on both sides
+static unsigned int inode_seq[NUM_INODES];
+
+// copy of the on-disk inode table. inodes are copied in one at a time from
+// the cache before their block is written, so a block never carries another
+// inode while a different thread is half way through changing it
+static INODE inode_table_disk[NUM_INODES];
+static pthread_mutex_t inode_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// guards the stack of free descriptors and the open counts
+static pthread_mutex_t fd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// the free map has a bit per data block, set when the block is allocated. it
+// is kept in memory and split into allocation groups of consecutive blocks,
+// each with its own lock and free count, so threads allocating from
+// different groups don't wait for each other. a group's words are only
+// changed under its lock, the whole map is written to disk by fm_flush.
+// freed blocks are held, neither allocated nor free, until the transaction
+// freeing them is committed to the journal, so a crash can't leave a block
+// referenced by its old owner holding the data of a new one. a disk whose
+// only unallocated blocks are held is full until the next commit
+
+// freemap bit associated with a data block address
+#define FM_BIT(address) ((address) - FM_FIRST_DATA_BLOCK)
+
+typedef struct FM_GROUP {
+    pthread_mutex_t lock;
+    int free; // number of free blocks in the group
+    int held; // number of held blocks in the group
+    int next; // bit the next search in the group starts from
+} FM_GROUP;
+
+static unsigned int fm_words[BLOCK_SIZE / sizeof(unsigned int)];
+static unsigned int fm_held[BLOCK_SIZE / sizeof(unsigned int)];
+static FM_GROUP fm_groups[FM_GROUPS] = {
+    [0 ... FM_GROUPS - 1] = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0 }
+};
+
+// orders writes of the free map block, each one a copy of the whole map
+static pthread_mutex_t fm_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int fm_test(int b)
 {
-    // BLOCK_SIZE * 8 is the number of bits needed
-    // dividing by 32 gives the number of ints needed
-    int freemap[(BLOCK_SIZE * 8) / 32]; 
-    int free_blocks_found = 0;
+    return (__atomic_load_n(&(fm_words[b / 32]), __ATOMIC_RELAXED) >> (b % 32)) & 1;
+}
 
-    // read free map
-    read_blocks(1 + INODE_TABLE_LENGTH, 1, freemap);
+// sets or clears a bit, the caller holds the lock of its group
+static void fm_set(int b, int allocated)
+{
+    unsigned int word = fm_words[b / 32];
+    if (allocated)
+        word |= 1u << (b % 32);
+    else
+        word &= ~(1u << (b % 32));
+    __atomic_store_n(&(fm_words[b / 32]), word, __ATOMIC_RELAXED);
+}
+
+static int fm_is_held(int b)
+{
+    return (fm_held[b / 32] >> (b % 32)) & 1;
+}
 
-    // query each index of the freemap until enough free blocks are found
-    int i;
-    for (i = 0; i < BLOCK_SIZE; i++)
+void fm_init(const int *group_free)
+{
+    if (bc_read(FM_ADDRESS, fm_words) < 0)
     {
-        // test the appropriate bit in the freemap
-        if ((freemap[i/32] & (1 << (i%32))) == 0)
-            free_blocks_found++;
-        // stop looking for free blocks when enough have been found
-        if (free_blocks_found == blocks_requested)
-            break;
+        printf("error reading the free map\n");
+        exit(1);
     }
+    memset(fm_held, 0, sizeof(fm_held));
+
+    for (int g = 0; g < FM_GROUPS; g++)
+    {
+        fm_groups[g].free = 0;
+        fm_groups[g].held = 0;
+        fm_groups[g].next = g * FM_GROUP_BITS;
+        if (group_free != NULL)
+        {
+            fm_groups[g].free = group_free[g];
+            continue;
+        }
 
-    return free_blocks_found == blocks_requested;
+        for (int b = g * FM_GROUP_BITS; b < (g + 1) * FM_GROUP_BITS; b++)
+        {
+            if (!fm_test(b))
+                fm_groups[g].free++;
+        }
+    }
 }
 
+void fm_counts(int *group_free)
+{
+    // held blocks are free in the map written to disk, they are released
+    // once the transaction freeing them commits
+    for (int g = 0; g < FM_GROUPS; g++)
+    {
+        pthread_mutex_lock(&(fm_groups[g].lock));
+        group_free[g] = fm_groups[g].free + fm_groups[g].held;
+        pthread_mutex_unlock(&(fm_groups[g].lock));
+    }
+}
+
+int fm_is_available(int blocks_requested)
+{
+    int free_blocks_found = 0;
+    for (int g = 0; g < FM_GROUPS; g++)
+        free_blocks_found += __atomic_load_n(&(fm_groups[g].free), __ATOMIC_RELAXED);
+
+    return free_blocks_found >= blocks_requested;
+}
 
-int fm_get_next_address_and_allocate()
+int fm_held_count()
 {
-    int next_address = -1;
-    int freemap[(BLOCK_SIZE * 8) / 32];
+    int held = 0;
+    for (int g = 0; g < FM_GROUPS; g++)
+        held += __atomic_load_n(&(fm_groups[g].held), __ATOMIC_RELAXED);
+
+    return held;
+}
 
-    // read free map
-    read_blocks(1 + INODE_TABLE_LENGTH, 1, freemap);
+// allocates a free block of the group. returns its bit, or -1 if there is
+// none. the caller holds the group's lock
+static int fm_allocate_in(int group)
+{
+    FM_GROUP *g = &(fm_groups[group]);
+    int first = group * FM_GROUP_BITS;
 
-    // query each index of the freemap until a free block is found
-    int i;
-    for (i = 0; i < BLOCK_SIZE; i++)
+    for (int j = 0; j < FM_GROUP_BITS; j++)
     {
-        // test the appropriate bit in the freemap
-        if ((freemap[i/32] & (1 << (i%32))) == 0)
+        // carry on from where the last search stopped, whole words of
+        // allocated blocks are skipped at once
+        int b = first + (g->next - first + j) % FM_GROUP_BITS;
+        unsigned int unavailable = fm_words[b / 32] | fm_held[b / 32];
+        if (b % 32 == 0 && unavailable == 0xffffffffu && j + 32 <= FM_GROUP_BITS)
         {
-            // set the ith bit in the freemap and write it to the disk
-            freemap[i/32] = freemap[i/32] | (1 << i%32);
-            write_blocks(1 + INODE_TABLE_LENGTH, 1, freemap);
+            j += 31;
+            continue;
+        }
 
-            // need to add the offset to the address of the first data block
-            next_address = 1 + INODE_TABLE_LENGTH + 1 + i;
-            break; // stop searching when a free block is found
+        if (!fm_test(b) && !fm_is_held(b))
+        {
+            fm_set(b, 1);
+            __atomic_store_n(&(g->free), g->free - 1, __ATOMIC_RELAXED);
+            g->next = (b + 1 == first + FM_GROUP_BITS) ? first : b + 1;
+            return b;
         }
     }
+    return -1;
+}
+
+int fm_allocate(int group)
+{
+    for (int i = 0; i < FM_GROUPS; i++)
+    {
+        int g = (group + i) % FM_GROUPS;
+
+        // full groups are skipped without taking their lock
+        if (__atomic_load_n(&(fm_groups[g].free), __ATOMIC_RELAXED) == 0)
+            continue;
+
+        pthread_mutex_lock(&(fm_groups[g].lock));
+        int b = fm_allocate_in(g);
+        pthread_mutex_unlock(&(fm_groups[g].lock));
+
+        if (b != -1)
+            return FM_FIRST_DATA_BLOCK + b;
+    }
+    return -1;
+}
+
+void fm_free(int address)
+{
+    int b = FM_BIT(address);
+    FM_GROUP *g = &(fm_groups[b / FM_GROUP_BITS]);
+
+    pthread_mutex_lock(&(g->lock));
+    int freed = fm_test(b);
+    if (freed)
+    {
+        fm_set(b, 0);
+        fm_held[b / 32] |= 1u << (b % 32);
+        __atomic_store_n(&(g->held), g->held + 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&(g->lock));
+
+    if (freed)
+        jn_freed(address);
+}
+
+void fm_release(int address)
+{
+    int b = FM_BIT(address);
+    FM_GROUP *g = &(fm_groups[b / FM_GROUP_BITS]);
+
+    pthread_mutex_lock(&(g->lock));
+    if (fm_is_held(b))
+    {
+        fm_held[b / 32] &= ~(1u << (b % 32));
+        __atomic_store_n(&(g->held), g->held - 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&(g->free), g->free + 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&(g->lock));
+}
 
-    return next_address;
+void fm_flush()
+{
+    unsigned int freemap[BLOCK_SIZE / sizeof(unsigned int)];
+
+    // the copy is taken under the flush lock, so whichever write comes last
+    // holds every change made before it started
+    pthread_mutex_lock(&fm_flush_lock);
+    for (int i = 0; i < BLOCK_SIZE / sizeof(unsigned int); i++)
+        freemap[i] = __atomic_load_n(&(fm_words[i]), __ATOMIC_RELAXED);
+    jn_write(FM_ADDRESS, freemap);
+    pthread_mutex_unlock(&fm_flush_lock);
+}
+
+void inode_rdlock(int inode_num)
+{
+    pthread_rwlock_rdlock(&(inode_locks[inode_num]));
+}
+
+void inode_wrlock(int inode_num)
+{
+    pthread_rwlock_wrlock(&(inode_locks[inode_num]));
+}
+
+void inode_unlock(int inode_num)
+{
+    pthread_rwlock_unlock(&(inode_locks[inode_num]));
+}
+
+int inode_size(int inode_num)
+{
+    unsigned int seq;
+    int size;
+
+    do
+    {
+        while ((seq = __atomic_load_n(&(inode_seq[inode_num]), __ATOMIC_ACQUIRE)) & 1)
+            ;
+        size = __atomic_load_n(&(inode_table_cache[inode_num].size), __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&(inode_seq[inode_num]), __ATOMIC_RELAXED) != seq);
+
+    return size;
+}
+
+void inode_set_size(int inode_num, int size)
+{
+    // writers are ordered by the inode's lock, only readers need the count
+    unsigned int seq = inode_seq[inode_num];
+    __atomic_store_n(&(inode_seq[inode_num]), seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&(inode_table_cache[inode_num].size), size, __ATOMIC_RELAXED);
+    __atomic_store_n(&(inode_seq[inode_num]), seq + 2, __ATOMIC_RELEASE);
+}
+
+// the open file descriptor table is made of chunks which never move once
+// allocated, so entries stay valid while another thread grows the table.
+// chunk k holds MAX_OPEN_FILES << k entries
+#define FD_CHUNKS 24
+static OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fd_chunks[FD_CHUNKS];
+static int fd_table_size = 0;
+
+// stack of the invalid entries of the open file descriptor table, the lowest
+// one on top
+static int *free_fds = NULL;
+static int num_free_fds = 0;
+
+// number of open file descriptors referring to each inode
+static int inode_open_count[NUM_INODES];
+
+static OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fd_entry(int fd)
+{
+    // chunk k starts at entry MAX_OPEN_FILES * (2^k - 1)
+    int k = 31 - __builtin_clz(fd / MAX_OPEN_FILES + 1);
+    return &(fd_chunks[k][fd - MAX_OPEN_FILES * ((1 << k) - 1)]);
+}
+
+// adds a chunk to the table and pushes its entries on the free stack. returns
+// -1 if memory can't be allocated or the table can't grow any further
+static int grow_open_file_descriptor_table()
+{
+    int k = 0;
+    while (k < FD_CHUNKS && fd_chunks[k] != NULL)
+        k++;
+    if (k == FD_CHUNKS)
+        return -1;
+
+    int chunk_size = MAX_OPEN_FILES << k;
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *chunk = (OPEN_FILE_DESCRIPTOR_TABLE_ENTRY*)
+            calloc(chunk_size, sizeof(OPEN_FILE_DESCRIPTOR_TABLE_ENTRY));
+    if (chunk == NULL)
+        return -1;
+
+    // every free entry is on the stack before growing, so it has room
+    int new_size = fd_table_size + chunk_size;
+    int *stack = (int*) realloc(free_fds, new_size * sizeof(int));
+    if (stack == NULL)
+    {
+        free(chunk);
+        return -1;
+    }
+    free_fds = stack;
+
+    for (int i = new_size - 1; i >= fd_table_size; i--)
+        free_fds[num_free_fds++] = i;
+
+    // the chunk must be in place before get_fd_entry can see the new size
+    fd_chunks[k] = chunk;
+    __atomic_store_n(&fd_table_size, new_size, __ATOMIC_RELEASE);
+    return 0;
 }
 
 void init_open_file_descriptor_table()
 {
     // make sure every entry is set to invalid
-    for (int i = 0; i < MAX_OPEN_FILES; i++)
-        open_file_descriptor_table[i].valid = 0;
+    for (int i = 0; i < fd_table_size; i++)
+    {
+        if (fd_entry(i)->valid)
+            free(fd_entry(i)->wbuf);
+    }
+    for (int k = 0; k < FD_CHUNKS; k++)
+    {
+        free(fd_chunks[k]);
+        fd_chunks[k] = NULL;
+    }
+    free(free_fds);
+    fd_table_size = 0;
+    free_fds = NULL;
+    num_free_fds = 0;
+    memset(inode_open_count, 0, sizeof(inode_open_count));
+
+    grow_open_file_descriptor_table();
 }
 
-int get_next_fd()
+int get_next_fd(int inode_num)
 {
-    int next_fd = -1;
-
-    for (int i = 0; i < MAX_OPEN_FILES; i++)
+    pthread_mutex_lock(&fd_lock);
+    if (num_free_fds == 0 && grow_open_file_descriptor_table() == -1)
     {
-        if (!open_file_descriptor_table[i].valid)
-        {
-            next_fd = i;
-            break; // stop searching when the first available entry is found
-        }
+        pthread_mutex_unlock(&fd_lock);
+        return -1;
     }
 
+    int next_fd = free_fds[--num_free_fds];
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr = fd_entry(next_fd);
+    fde_ptr->valid = 1;
+    fde_ptr->inode_num = inode_num;
+    fde_ptr->rptr = 0;
+    fde_ptr->wptr = 0;
+    fde_ptr->wbuf = NULL;
+    fde_ptr->wbuf_index = -1;
+    fde_ptr->wbuf_dirty = 0;
+    fde_ptr->inode_dirty = 0;
+    fde_ptr->write_error = 0;
+    inode_open_count[inode_num]++;
+    pthread_mutex_unlock(&fd_lock);
     return next_fd;
 }
 
-// return 0 if no space available
-int allocate_block_to_inode(INODE *inode)
+void release_fd(int fd)
 {
-    //TODO check that the inode is full given the current number 
-    // of allocated inode
+    OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *fde_ptr = fd_entry(fd);
 
-    // number of blocks currently used by inode
-    int current_blocks = (inode->size == 0) ? 0 : inode->size / BLOCK_SIZE;
-    // need to allocate two blocks if we need to allocate the indirect pointer block
-    int blocks_required = (current_blocks == 12) ? 2 : 1;
+    pthread_mutex_lock(&fd_lock);
+    fde_ptr->valid = 0;
+    free(fde_ptr->wbuf);
+    fde_ptr->wbuf = NULL;
+    inode_open_count[fde_ptr->inode_num]--;
+    free_fds[num_free_fds++] = fd;
+    pthread_mutex_unlock(&fd_lock);
+}
 
-    // check that allocating a block block won't exceed what an inode
-    // can refer to
-    if (current_blocks + 1 > (12 + 256))
-        return -1;
+OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *get_fd_entry(int fd)
+{
+    if (fd < 0 || fd >= __atomic_load_n(&fd_table_size, __ATOMIC_ACQUIRE)
+            || !fd_entry(fd)->valid)
+    {
+        return NULL;
+    }
+    return fd_entry(fd);
+}
 
-    // check that the requested number of blocks are available
-    if (!fm_is_available(blocks_required))
+int get_fd_table_size()
+{
+    return __atomic_load_n(&fd_table_size, __ATOMIC_ACQUIRE);
+}
+
+int is_inode_open(int inode_num)
+{
+    pthread_mutex_lock(&fd_lock);
+    int open = inode_open_count[inode_num] > 0;
+    pthread_mutex_unlock(&fd_lock);
+    return open;
+}
+
+// return -1 if no space available
+int allocate_block_to_inode(INODE *inode, int index)
+{
+    // check that the index is within what an inode can refer to
+    if (index < 0 || index >= (12 + 256))
         return -1;
 
-    // allocate new block
-    int new_block_address = fm_get_next_address_and_allocate();
+    // blocks of an inode come from the group matching its number first, so
+    // they are near each other and writers of different files don't share
+    // a group
+    int group = (inode - inode_table_cache) % FM_GROUPS;
 
-    // allocate indirect pointer block if necessary
-    if (current_blocks == 12)
+    // need to allocate two blocks if the indirect pointer block doesn't exist yet
+    int needs_ind_block = (index >= 12 && inode->ind_ptr == 0);
+    int ind_block_address = 0;
+    if (needs_ind_block)
     {
-        inode->ind_ptr = fm_get_next_address_and_allocate();
+        ind_block_address = fm_allocate(group);
+        if (ind_block_address == -1)
+            return -1;
     }
+
+    // allocate new block
+    int new_block_address = fm_allocate(group);
+    if (new_block_address == -1)
+    {
+        if (needs_ind_block)
+            fm_free(ind_block_address);
+        return -1;
+    }
+    fm_flush();
     
     // set new block pointer in inode
-    if (current_blocks < 12)
+    if (index < 12)
     {
-        inode->direct_ptr[current_blocks] = new_block_address;
+        inode->direct_ptr[index] = new_block_address;
     }
     else // set in indirect pointer table
     {
-        // read indirect block
         int indirect_block_buf[256]; // holds 256 direct addresses
-        read_blocks(inode->ind_ptr, 1, indirect_block_buf);
+
+        // allocate indirect pointer block if necessary
+        if (needs_ind_block)
+        {
+            inode->ind_ptr = ind_block_address;
+            // every pointer in a fresh indirect block is unallocated
+            memset(indirect_block_buf, 0, sizeof(indirect_block_buf));
+        }
+        else
+        {
+            bc_read(inode->ind_ptr, indirect_block_buf);
+        }
         
         // set direct pointer in indirect block and write it to disk
-        indirect_block_buf[current_blocks - 12] = new_block_address;
-        write_blocks(inode->ind_ptr, 1, indirect_block_buf);
+        indirect_block_buf[index - 12] = new_block_address;
+        jn_write(inode->ind_ptr, indirect_block_buf);
     }
-    
-    return 0;
+
+    return new_block_address;
+}
+
+void deallocate_inode_blocks(INODE *inode, int first_index)
+{
+    if (first_index < 0)
+        first_index = 0;
+
+    // free the blocks pointed to by the direct pointers
+    for (int i = first_index; i < 12; i++)
+    {
+        if (inode->direct_ptr[i] != 0)
+        {
+            fm_free(inode->direct_ptr[i]);
+            inode->direct_ptr[i] = 0;
+        }
+    }
+
+    // free the blocks pointed to by the indirect block
+    if (inode->ind_ptr != 0)
+    {
+        int indirect_block[256];
+        int start = (first_index > 12) ? first_index - 12 : 0;
+
+        bc_read(inode->ind_ptr, indirect_block);
+        for (int i = start; i < 256; i++)
+        {
+            if (indirect_block[i] != 0)
+            {
+                fm_free(indirect_block[i]);
+                indirect_block[i] = 0;
+            }
+        }
+
+        // the indirect block itself goes once it no longer points to anything
+        int in_use = 0;
+        for (int i = 0; i < start && !in_use; i++)
+            in_use = (indirect_block[i] != 0);
+
+        if (!in_use)
+        {
+            fm_free(inode->ind_ptr);
+            inode->ind_ptr = 0;
+        }
+        else
+        {
+            jn_write(inode->ind_ptr, indirect_block);
+        }
+    }
+
+    fm_flush();
 }
 
 int inode_index_to_address(INODE inode, int index)
 {
-    // check if the requested index is larger than the number of blocks allocated
-    if (index > (inode.size / BLOCK_SIZE))
+    // check that the index is within what an inode can refer to
+    if (index < 0 || index >= (12 + 256))
         return -1;
 
     int block_address;
@@ -145,28 +543,208 @@ int inode_index_to_address(INODE inode, int index)
     {
         block_address = inode.direct_ptr[index];
     }
+    else if (inode.ind_ptr == 0) // no indirect block, nothing allocated past 12
+    {
+        block_address = 0;
+    }
     else // get address from indirect pointer
     {
         // read indirect block
         int indirect_block[256];
-        read_blocks(inode.ind_ptr, 1, indirect_block);
+        bc_read(inode.ind_ptr, indirect_block);
         block_address = indirect_block[index - 12];
     }
 
     return block_address;
 }
 
-// return 1 if file already open
-int is_file_open(char *file)
+void inode_to_disk(int inode_num)
 {
-    int file_already_open = 0;
-    int inode_num = rdc_get_inode_num(file);
+    int inodes_per_block = BLOCK_SIZE / sizeof(INODE);
+    int first = inode_num - (inode_num % inodes_per_block);
 
-    for (int i = 0; i < MAX_OPEN_FILES; i++)
+    pthread_mutex_lock(&inode_table_lock);
+    inode_table_disk[inode_num] = inode_table_cache[inode_num];
+    jn_write(1 + inode_num / inodes_per_block, &(inode_table_disk[first]));
+    pthread_mutex_unlock(&inode_table_lock);
+}
+
+void load_inode_table(const unsigned int *used)
+{
+    int inodes_per_block = BLOCK_SIZE / sizeof(INODE);
+
+    if (used == NULL)
     {
-        OPEN_FILE_DESCRIPTOR_TABLE_ENTRY table_entry = open_file_descriptor_table[i];
-        if (table_entry.valid && table_entry.inode_num == inode_num)
-            file_already_open = 1;
+        if (io_read(1, INODE_TABLE_LENGTH, inode_table_disk) < 0)
+        {
+            printf("error reading the inode table\n");
+            exit(1);
+        }
+        // the journal holds newer copies of blocks only if it was replayed
+        // read only
+        for (int b = 0; b < INODE_TABLE_LENGTH; b++)
+            jn_read(1 + b, &(inode_table_disk[b * inodes_per_block]));
+        memcpy(inode_table_cache, inode_table_disk, sizeof(inode_table_disk));
+        return;
     }
-    return file_already_open;
-}
\ No newline at end of file
+
+    // blocks without a valid inode are left zeroed, the others are read in
+    // runs of consecutive blocks
+    memset(inode_table_disk, 0, sizeof(inode_table_disk));
+    int run = -1;
+    for (int b = 0; b <= INODE_TABLE_LENGTH; b++)
+    {
+        int in_use = 0;
+        if (b < INODE_TABLE_LENGTH)
+        {
+            for (int i = b * inodes_per_block; i < (b + 1) * inodes_per_block; i++)
+                in_use |= (used[i / 32] >> (i % 32)) & 1;
+        }
+
+        if (in_use && run == -1)
+        {
+            run = b;
+        }
+        else if (!in_use && run != -1)
+        {
+            if (io_read(1 + run, b - run, &(inode_table_disk[run * inodes_per_block])) < 0)
+            {
+                printf("error reading the inode table\n");
+                exit(1);
+            }
+            run = -1;
+        }
+    }
+    memcpy(inode_table_cache, inode_table_disk, sizeof(inode_table_disk));
+}
+
+void super_block_to_disk()
+{
+    // the struct is smaller than a block, the rest of the block is zeroed
+    char block_buf[BLOCK_SIZE];
+    memset(block_buf, 0, BLOCK_SIZE);
+    memcpy(block_buf, &super_block_cache, sizeof(SUPER_BLOCK));
+    jn_write(0, block_buf);
+}
+
+int allocate_inode(int mode)
+{
+    for (int i = 0; i < INODE_TABLE_LENGTH * (BLOCK_SIZE/sizeof(INODE)); i++)
+    {
+        if (!inode_table_cache[i].valid)
+        {
+            INODE *inode_ptr = &(inode_table_cache[i]);
+
+            // start with an empty block map, disk is updated by the caller.
+            // a lookup without the directory lock may still be reading the
+            // mode and size of the inode's previous use, so they are stored
+            // atomically. such a lookup is discarded by its read section, as
+            // the name it found was removed before the inode was freed
+            memset(inode_ptr->direct_ptr, 0, sizeof(inode_ptr->direct_ptr));
+            inode_ptr->ind_ptr = 0;
+            inode_ptr->uid = 0;
+            inode_ptr->gid = 0;
+            inode_ptr->link_count = 1;
+            inode_ptr->free_block = -1;
+            __atomic_store_n(&(inode_ptr->mode), mode, __ATOMIC_RELAXED);
+            inode_set_size(i, 0);
+            inode_ptr->valid = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// path_parent, looking the directories leading to the last component up with
+// the given function
+static int walk(const char *path, char *name, int (*lookup)(int, const char*))
+{
+    int dir = ROOT_DIR_INODE_NUM;
+    const char *c = path;
+
+    while (1)
+    {
+        while (*c == '/')
+            c++;
+
+        // length of the current component
+        int len = 0;
+        while (c[len] != '/' && c[len] != '\0')
+            len++;
+        if (len > MAX_FILENAME)
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+
+        memcpy(name, c, len);
+        name[len] = '\0';
+
+        const char *rest = c + len;
+        while (*rest == '/')
+            rest++;
+        if (*rest == '\0')
+            return dir;
+
+        // every component but the last one must be a directory
+        dir = lookup(dir, name);
+        if (dir == -1)
+        {
+            errno = ENOENT;
+            return -1;
+        }
+        if (__atomic_load_n(&(inode_table_cache[dir].mode), __ATOMIC_RELAXED) != MODE_DIR)
+        {
+            errno = ENOTDIR;
+            return -1;
+        }
+        c = rest;
+    }
+}
+
+int path_parent(const char *path, char *name)
+{
+    return walk(path, name, dc_lookup);
+}
+
+int path_lookup(const char *path)
+{
+    char name[MAX_FILENAME + 1];
+    int dir = path_parent(path, name);
+    if (dir == -1)
+        return -1;
+
+    // the path only had slashes, it is the root directory
+    if (name[0] == '\0')
+        return dir;
+
+    int inode_num = dc_lookup(dir, name);
+    if (inode_num == -1)
+        errno = ENOENT;
+    return inode_num;
+}
+
+int path_lookup_cached(const char *path, int *mode, int *size)
+{
+    char name[MAX_FILENAME + 1];
+    DC_READ section;
+
+    dc_read_begin(&section);
+    int inode_num = walk(path, name, dc_lookup_cached);
+    if (inode_num != -1 && name[0] != '\0')
+        inode_num = dc_lookup_cached(inode_num, name);
+
+    // read in the section, so the inode can't be reused for another file
+    // without the section noticing the removal of the name
+    if (inode_num != -1)
+    {
+        *mode = __atomic_load_n(&(inode_table_cache[inode_num].mode), __ATOMIC_RELAXED);
+        *size = inode_size(inode_num);
+    }
+
+    // a removal during the walk may have left it with a stale entry
+    if (!dc_read_end(&section))
+        return -1;
+
+    return inode_num;
+}
@@ -1,46 +1,216 @@
 #include "common.h"
 
+/**
+ * reads the free map from disk and counts the free blocks of each allocation
+ * group, unless group_free holds the counts saved by fm_counts. must be
+ * called once the block cache is initialized
+ */
+void fm_init(const int *group_free);
+
+/**
+ * copies the number of free blocks of each allocation group to group_free,
+ * counting the blocks waiting for the journal to release them as free
+ */
+void fm_counts(int *group_free);
+
 /**
  * returns 1 if the given number of blocks is available in the free map.
- * returns 0 otherwise
+ * returns 0 otherwise. the count may already be stale when it returns
  */
 int fm_is_available(int blocks_requested);
 
 /**
- * sets the next free bit in the free map to allocated and returns the address
- * of its associated block
- * returns -1 if no blocks are free, i.e. the disk is full
+ * returns the number of blocks freed by fm_free and not released yet. they
+ * become available once the journal commits the transaction freeing them.
+ * the count may already be stale when it returns
+ */
+int fm_held_count();
+
+/**
+ * sets a free bit of the free map to allocated and returns the address of
+ * its associated block. the given allocation group is searched first, the
+ * other ones in turn if it is full. the change is in memory only until
+ * fm_flush
+ * returns -1 if no blocks are free, i.e. the disk is full. blocks held until
+ * a commit are not free
+ */
+int fm_allocate(int group);
+
+/**
+ * sets the bit of the block at the given address to free. the change is in
+ * memory only until fm_flush. the block isn't allocated again before the
+ * journal releases it with fm_release, once the change is committed
+ */
+void fm_free(int address);
+
+/**
+ * makes a block freed by fm_free available for allocation
+ */
+void fm_release(int address);
+
+/**
+ * writes the free map to disk through the journal
  */
-int fm_get_next_address_and_allocate();
+void fm_flush();
 
 /**
- * sets every entry in the open file descriptor table to invalid
+ * takes the lock of the inode shared, for reading its contents. several
+ * threads may read an inode at once
+ */
+void inode_rdlock(int inode_num);
+
+/**
+ * takes the lock of the inode exclusively, for changing its contents or
+ * block map
+ */
+void inode_wrlock(int inode_num);
+
+/**
+ * releases the lock of the inode taken by either of the above
+ */
+void inode_unlock(int inode_num);
+
+/**
+ * returns the size of the inode without taking its lock. a size being
+ * changed by another thread is waited for, so the value is never torn and
+ * the call never waits for a writer to finish the rest of its work
+ */
+int inode_size(int inode_num);
+
+/**
+ * sets the size of the inode in the inode table cache so that inode_size
+ * reads it consistently. the caller holds the inode's lock exclusively, or
+ * the directory lock for a directory
+ */
+void inode_set_size(int inode_num, int size);
+
+/**
+ * empties the open file descriptor table, making room for MAX_OPEN_FILES
+ * entries to start with. must not be called while other threads use it
  */
 void init_open_file_descriptor_table();
 
 /**
- * returns the index of the first invalid file descriptor entry.
- * returns -1 if no entry is found, i.e. the maximum number of files has 
- * already been opened
+ * takes the lowest invalid entry off the stack of free file descriptors and
+ * marks it valid for the given inode, doubling the table when every entry is
+ * in use. entries never move, so pointers to them stay valid until the
+ * descriptor is released
+ * returns -1 if the table could not be grown
+ * returns the index of the entry otherwise
+ */
+int get_next_fd(int inode_num);
+
+/**
+ * marks the entry invalid and puts it back on the stack of free descriptors.
+ * its write buffer is freed without being written, callers flush it first
  */
-int get_next_fd();
+void release_fd(int fd);
 
 /**
- * allocates a block and sets the given inode to point to it. the function uses
- * the inodes size to determine what pointer to set so it should only be called 
- * when no more data can be written with the current number of allocated blocks
+ * returns the open file descriptor table entry of the given file ID, or NULL
+ * if it doesn't refer to an open file
+ */
+OPEN_FILE_DESCRIPTOR_TABLE_ENTRY *get_fd_entry(int fd);
+
+/**
+ * returns the number of entries of the open file descriptor table, valid or
+ * not. file IDs range from 0 to one less than it
+ */
+int get_fd_table_size();
+
+/**
+ * returns 1 if a file descriptor refers to the inode, 0 otherwise
+ */
+int is_inode_open(int inode_num);
+
+/**
+ * allocates a block and sets the inode's block pointer at the given index to
+ * point to it. the indirect pointer block is allocated as well when the index
+ * needs it and the inode doesn't have one yet
+ * 
+ * the caller holds the inode's lock exclusively, or the directory lock for a
+ * directory. the allocation groups are locked here
  * 
  * returns -1 if the allocation fails
- * returns 0 on success
+ * returns the address of the new block on success
  */
-int allocate_block_to_inode(INODE *inode);
+int allocate_block_to_inode(INODE *inode, int index);
+
+/**
+ * frees every block allocated to the inode at or after the given index and
+ * clears the pointers to them. the indirect pointer block is freed too once
+ * none of its pointers are in use
+ */
+void deallocate_inode_blocks(INODE *inode, int first_index);
 
 /**
  * maps an inodes block pointer to its associated disk-address. 
  * 
- * returns -1 if the index refers to a pointer that does not point to an 
- * allocated block
- * returns 0 on success
+ * returns -1 if the index is larger than what an inode can refer to
+ * returns 0 if no block is allocated at the index, i.e. it is a hole
+ * returns the address of the block otherwise
  */
 int inode_index_to_address(INODE inode, int index);
-int is_file_open(char *file);
\ No newline at end of file
+
+/**
+ * writes the cached copy of the given inode to the on-disk inode table. only
+ * the one block of the table holding the inode is written, with the other
+ * inodes of the block as they were last written. like every metadata block
+ * it goes through the journal
+ */
+void inode_to_disk(int inode_num);
+
+/**
+ * reads the on-disk inode table into the inode table cache. if used isn't
+ * NULL, only the blocks of the table holding an inode whose bit is set in it
+ * are read, the others are cached as invalid inodes. if it is NULL, blocks
+ * kept by a read only replay of the journal replace those of the disk
+ */
+void load_inode_table(const unsigned int *used);
+
+/**
+ * writes the cached copy of the super block to the first block of the disk
+ * through the journal
+ */
+void super_block_to_disk();
+/**
+ * finds an invalid inode in the inode table cache and initializes it as an
+ * empty file or directory, depending on mode. it is up to the caller to
+ * write it to disk. inodes are only allocated and freed while holding the
+ * directory lock of sfs_api.c
+ * 
+ * returns -1 if every inode is in use
+ * returns the number of the inode on success
+ */
+int allocate_inode(int mode);
+
+/**
+ * resolves every component of the path but the last one, which is stored in
+ * name. components are separated by '/' and paths are relative to the root
+ * directory whether they start with '/' or not. name is empty when the path
+ * is the root directory
+ * 
+ * returns -1 and sets errno to ENAMETOOLONG if a component is too long,
+ * ENOENT or ENOTDIR if one of the directories leading to the last component
+ * doesn't exist or isn't a directory
+ * returns the inode number of the directory holding the last component
+ */
+int path_parent(const char *path, char *name);
+
+/**
+ * returns the inode number of the file or directory at the given path, -1
+ * if it doesn't exist, with errno set as by path_parent
+ */
+int path_lookup(const char *path);
+
+/**
+ * resolves the path from the entries already in the directory cache only,
+ * without taking the directory lock or reading the disk, and sets mode and
+ * size to those of the inode found
+ * 
+ * returns -1 if a component isn't cached or the path changed while it was
+ * resolved, in which case path_lookup should be called with the directory
+ * lock held
+ * returns the inode number of the file or directory at the path otherwise
+ */
+int path_lookup_cached(const char *path, int *mode, int *size);
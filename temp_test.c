@@ -1,5 +1,5 @@
 #include "sfs_api.h"
-#include "root_dir_cache.h"
+#include "dir_cache.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>